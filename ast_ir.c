@@ -221,17 +221,7 @@ void copy_ref(iropr_var_t *lhs, iropr_var_t *rhs) {
   assert(rhs->type->typeid == E_type_ref);
   type_ref_t *rhs_ref = (type_ref_t *)(rhs->type);
   int size = MIN(lhs_ref->ref->size, rhs_ref->ref->size);
-  for (int i = 0; i < size; i += 4) {
-    iropr_var_t *mrhs = gen_temp_var(&INT),
-                *tmp = gen_temp_var(&INT),
-                *mlhs = gen_temp_var(&INT);
-    add_ir(IRNEW(ir_arth, mrhs, (void*)rhs, 
-                  (void*)IROPRNEW(iropr_imm, i), OP2_PLUS));
-    add_ir(IRNEW(ir_load, tmp, mrhs));
-    add_ir(IRNEW(ir_arth, mlhs, (void*)lhs, 
-                  (void*)IROPRNEW(iropr_imm, i), OP2_PLUS));
-    add_ir(IRNEW(ir_store, mlhs, (void*)tmp));
-  }
+  add_ir(IRNEW(ir_memcpy, lhs, rhs, size));
 }
 
 DEF_VISIT_FUNC(ast_ir, dec) {
@@ -275,6 +265,47 @@ static void *ast_ir_exp_v2b(ast_ir_t *v, void *n) {
   return var;
 }
 
+// var := exp as 0 / 1 without branching
+static void ast_ir_set(ast_ir_t *v, iropr_var_t *var, void *exp) {
+  abstract_node_t *node = exp;
+  if (node->astid == E_exp__para) {
+    ast_ir_set(v, var, ((exp__para_t *)exp)->exp);
+  } else if (node->astid == E_exp__2op && ((exp__2op_t *)exp)->op == OP2_RELOP) {
+    exp__2op_t *n = exp;
+    iropr_t *lhs = iropr2atom(ast_visit(v, n->lexp));
+    iropr_t *rhs = iropr2atom(ast_visit(v, n->rexp));
+    add_ir(IRNEW(ir_set, var, lhs, rhs, n->relop));
+  } else if (node->astid == E_exp__1op && ((exp__1op_t *)exp)->op == OP1_NOT) {
+    iropr_t *opr = iropr2atom(ast_visit(v, ((exp__1op_t *)exp)->exp));
+    add_ir(IRNEW(ir_set, var, opr, (void*)&IMM0, EQ));
+  } else {
+    iropr_t *opr = iropr2atom(ast_visit(v, exp));
+    add_ir(IRNEW(ir_set, var, opr, (void*)&IMM0, NEQ));
+  }
+}
+
+static void *ast_ir_exp_set(ast_ir_t *v, void *n) {
+  assert(v->branch == 0);
+  iropr_var_t *var = gen_temp_var(&INT);
+  ast_ir_set(v, var, n);
+  return var;
+}
+
+// the left operand decides with a branch, the right one is set in place
+static void *ast_ir_exp__andor_v(ast_ir_t *v, exp__2op_t *n) {
+  assert(v->branch == 0);
+  ir_label_t *label = gen_label(), *end = gen_label();
+  iropr_var_t *var = gen_temp_var(&INT);
+  int and = n->op == OP2_AND;
+  add_ir(IRNEW(ir_mov, var, (void*)(and ? &IMM0 : &IMM1)));
+  VTYPE v1 = {v->table, 1, and ? label : end, and ? end : label};
+  ast_visit(&v1, n->lexp);
+  add_ir(label);
+  ast_ir_set(v, var, n->rexp);
+  add_ir(end);
+  return var;
+}
+
 static void *ast_ir_exp_b2v(ast_ir_t *v, void *n) {
   assert(v->branch == 1);
   VTYPE v1 = {v->table, 0, NULL, NULL};
@@ -350,6 +381,9 @@ DEF_VISIT_FUNC(ast_ir, exp__2op) {
     case OP2_MINUS:
     case OP2_STAR:
     case OP2_DIV: return ast_ir_exp__2oparth_v(v, n);
+    case OP2_AND:
+    case OP2_OR: return ast_ir_exp__andor_v(v, n);
+    case OP2_RELOP: return ast_ir_exp_set(v, n);
     default: return ast_ir_exp_v2b(v, n);
     }
   } else {
@@ -387,6 +421,7 @@ DEF_VISIT_FUNC(ast_ir, exp__1op) {
   if (v->branch == 0) {
     switch (n->op) {
     case OP1_MINUS: return ast_ir_exp__minus_v(v, n);
+    case OP1_NOT: return ast_ir_exp_set(v, n);
     default: return ast_ir_exp_v2b(v, n);
     }
   } else {
@@ -20,6 +20,19 @@ void list_clear(list_t *lst) {
   lst->size = 0;
 }
 
+// drops the first occurrence of elem, keeping the order; 0 if absent
+int list_remove(list_t *lst, void *elem) {
+  for (int i = 0; i < lst->size; ++i) {
+    if (lst->array[i] == elem) {
+      memmove(lst->array + i, lst->array + i + 1, 
+        (lst->size - i - 1) * sizeof(void*));
+      lst->size--;
+      return 1;
+    }
+  }
+  return 0;
+}
+
 void *list_last(list_t *lst) {
   assert(lst->size > 0);
   return lst->array[lst->size - 1];
@@ -76,11 +89,44 @@ void bitset_or(bitset_t *dst, bitset_t *src) {
   }
 }
 
+void bitset_andnot(bitset_t *dst, bitset_t *src) {
+  assert(dst->size == src->size);
+  for (int i = 0; i < dst->size; ++i) {
+    dst->array[i] &= ~src->array[i];
+  }
+}
+
 int bitset_cmp(bitset_t *dst, bitset_t *src) {
   assert(dst->size == src->size);
   return !!memcmp(dst->array, src->array, dst->size * 8);
 }
 
+void bitset_resize(bitset_t *bs, int n) {
+  int size = (n + 63) / 64;
+  if (size <= bs->size) return;
+  bs->array = realloc(bs->array, size * 8);
+  memset(bs->array + bs->size, 0, (size - bs->size) * 8);
+  bs->size = size;
+}
+
+int bitset_next(bitset_t *bs, int n) {
+  if (n < 0) n = 0;
+  for (int i = n / 64; i < bs->size; ++i) {
+    uint64_t w = bs->array[i];
+    if (i == n / 64) w &= ~(MASK(n % 64) - 1);
+    if (w) return i * 64 + __builtin_ctzll(w);
+  }
+  return -1;
+}
+
+int bitset_meet(bitset_t *a, bitset_t *b) {
+  int size = a->size < b->size ? a->size : b->size;
+  for (int i = 0; i < size; ++i) {
+    if (a->array[i] & b->array[i]) return 1;
+  }
+  return 0;
+}
+
 static int round2power(int x) {
   assert(x > 0);
   x -= 1;
@@ -253,18 +299,32 @@ static uint64_t default_hash(void *k) {
   return (uint64_t)k;
 }
 
-hashmap_t *new_hmap(void *keqfunc, void *veqfunc, void *hashfunc, int is_top) {
+static uint64_t zero_hash(void *k) {
+  return 0;
+}
+
+hashmap_t *new_hmap(void *keqfunc, void *veqfunc, void *hashfunc, 
+    void *vhashfunc, int is_top) {
+  if (vhashfunc == NULL) vhashfunc = veqfunc == NULL ? default_hash : zero_hash;
   if (keqfunc == NULL) keqfunc = default_eqfunc;
   if (veqfunc == NULL) veqfunc = default_eqfunc;
   if (hashfunc == NULL) hashfunc = default_hash;
   hashmap_t *map = NEW(hashmap, calloc(8, sizeof(map_t*)), 0, 8, 
-    keqfunc, veqfunc, hashfunc, is_top);
+    keqfunc, veqfunc, hashfunc, vhashfunc, 0, is_top);
   for (int i = 0; i < 8; ++i) {
     map->buckets[i] = new_map(keqfunc, veqfunc);
   }
   return map;
 }
 
+static uint64_t entry_hash(hashmap_t *map, void *key, void *value) {
+  uint64_t h = map->hashfunc(key) * 0x9e3779b97f4a7c15ul ^ map->vhashfunc(value);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdul;
+  h ^= h >> 33;
+  return h;
+}
+
 static int hash2bk(uint64_t hash, int bknum) {
   hash ^= (hash >> 20) ^ (hash >> 12);
   return (int)((hash ^ (hash >> 4) ^ (hash >> 7)) & (bknum - 1));
@@ -299,7 +359,23 @@ static void hmap_rehash(hashmap_t *map, int target) {
 void hmap_put(hashmap_t *map, void *key, void *value) {
   assert(!map->is_top);
   int bkno = hash2bk(map->hashfunc(key), map->bknum);
-  map->size += map_put(map->buckets[bkno], key, value);
+  map_t *m = map->buckets[bkno];
+  node_t *n = map_find(m, key);
+  if (n) {
+    map->digest -= entry_hash(map, n->key, n->value);
+    if (value == NULL) {
+      map_delete(m, n);
+      map->size -= 1;
+      return;
+    }
+    n->value = value;
+  } else if (value == NULL) {
+    return;
+  } else {
+    map_insert(m, (n = NEW(node, key, value)));
+    map->size += 1;
+  }
+  map->digest += entry_hash(map, n->key, n->value);
   hmap_rehash(map, 0);
 }
 
@@ -312,16 +388,30 @@ void *hmap_get(hashmap_t *map, void *key) {
 void *hmap_remove(hashmap_t *map, void *key) {
   assert(!map->is_top);
   int bkno = hash2bk(map->hashfunc(key), map->bknum);
-  void *v = map_remove(map->buckets[bkno], key);
-  if (v) map->size -= 1;
-  return v;
+  map_t *m = map->buckets[bkno];
+  node_t *n = map_find(m, key);
+  if (n) {
+    map->digest -= entry_hash(map, n->key, n->value);
+    map_delete(m, n);
+    map->size -= 1;
+    return n->value;
+  }
+  return NULL;
 }
 
 int hmap_removeif(hashmap_t *map, void *condfunc) {
   assert(!map->is_top);
   int removed = 0;
+  int (*cond)(void *, void *) = condfunc;
   for (int i = 0; i < map->bknum; ++i) {
-    removed += map_removeif(map->buckets[i], condfunc);
+    map_t *m = map->buckets[i];
+    for (node_t *l = m->node.next; l != &(m->node); l = l->next) {
+      if (cond(l->key, l->value)) {
+        map->digest -= entry_hash(map, l->key, l->value);
+        map_delete(m, l);
+        removed += 1;
+      }
+    }
   }
   map->size -= removed;
   return removed;
@@ -333,14 +423,21 @@ void hmap_removeall(hashmap_t *map) {
     map_removeall(map->buckets[i]);
   }
   map->size = 0;
+  map->digest = 0;
 }
 
 static void hmap_recount(hashmap_t *map) {
   int size = 0;
+  uint64_t digest = 0;
   for (int i = 0; i < map->bknum; ++i) {
-    size += map->buckets[i]->size;
+    map_t *m = map->buckets[i];
+    size += m->size;
+    for (node_t *l = m->node.next; l != &(m->node); l = l->next) {
+      digest += entry_hash(map, l->key, l->value);
+    }
   }
   map->size = size;
+  map->digest = digest;
   hmap_rehash(map, 0);
 }
 
@@ -375,7 +472,9 @@ void hmap_copy(hashmap_t *dst, hashmap_t *src) {
     for (int i = 0; i < dst->bknum; ++i) {
       map_copy(dst->buckets[i], src->buckets[i]);
     }
-    hmap_recount(dst);
+    dst->size = src->size;
+    dst->digest = src->digest;
+    hmap_rehash(dst, 0);
   }
 }
 
@@ -389,7 +488,7 @@ void hmap_and(hashmap_t *dst, hashmap_t *src) {
 
 int hmap_cmp(hashmap_t *m1, hashmap_t *m2) {
   if (m1->is_top || m2->is_top) return m1->is_top != m2->is_top;
-  if (m1->size != m2->size) return 1;
+  if (m1->size != m2->size || m1->digest != m2->digest) return 1;
   hmap_rehash_like(m1, m2);
   for (int i = 0; i < m1->bknum; ++i) {
     if (map_cmp(m1->buckets[i], m2->buckets[i])) {
@@ -13,6 +13,7 @@ typedef struct list {
 list_t *new_list();
 void list_append(list_t *lst, void *elem);
 void list_clear(list_t *lst);
+int list_remove(list_t *lst, void *elem);
 void *list_last(list_t *lst);
 
 typedef struct bitset {
@@ -29,7 +30,11 @@ void bitset_one(bitset_t *bs);
 void bitset_copy(bitset_t *dst, bitset_t *src);
 void bitset_and(bitset_t *dst, bitset_t *src);
 void bitset_or(bitset_t *dst, bitset_t *src);
+void bitset_andnot(bitset_t *dst, bitset_t *src);
 int bitset_cmp(bitset_t *dst, bitset_t *src);
+void bitset_resize(bitset_t *bs, int n);
+int bitset_next(bitset_t *bs, int n); // first set bit >= n, -1 = none
+int bitset_meet(bitset_t *a, bitset_t *b); // any bit set in both
 
 typedef struct worklist {
   int *lst;
@@ -80,6 +85,8 @@ typedef struct hashmap {
   int (*keqfunc)(void *, void *);
   int (*veqfunc)(void *, void *);
   uint64_t (*hashfunc)(void *);
+  uint64_t (*vhashfunc)(void *);
+  uint64_t digest; // order-independent sum of entry hashes
   int is_top;
 } hashmap_t;
 
@@ -88,6 +95,7 @@ typedef struct hashmap {
 hashmap_t *new_hmap(void *keqfunc, // int (*keqfunc)(K, K);
   void *veqfunc, // int (*veqfunc)(V, V);
   void *hashfunc, // uint64_t hashfunc(K);
+  void *vhashfunc, // uint64_t vhashfunc(V); must agree with veqfunc
   int is_top);
 void hmap_put(hashmap_t *map, void *key, void *value);
 void *hmap_get(hashmap_t *map, void *key);
@@ -48,6 +48,34 @@ int is_iropr_imm(iropr_t *opr, int imm) {
   return opr->oprid == E_iropr_imm && ((iropr_imm_t *)opr)->val == imm;
 }
 
+int eval_relop(relop_t op, int x, int y) {
+  switch (op) {
+  case GT: return x > y;
+  case LE: return x <= y;
+  case GE: return x >= y;
+  case LT: return x < y;
+  case EQ: return x == y;
+  case NEQ: return x != y;
+  default: assert(0);
+  }
+  return 0;
+}
+
+// x op y wrapping like the target; 0 when it would trap
+int fold_const(op2_t op, int x, int y, int *r) {
+  switch (op) {
+  case OP2_PLUS: *r = (int)((unsigned)x + (unsigned)y); return 1;
+  case OP2_MINUS: *r = (int)((unsigned)x - (unsigned)y); return 1;
+  case OP2_STAR: *r = (int)((unsigned)x * (unsigned)y); return 1;
+  case OP2_DIV:
+    if (y == 0 || (x == (int)0x80000000 && y == -1)) return 0;
+    *r = x / y;
+    return 1;
+  default: assert(0);
+  }
+  return 0;
+}
+
 ir_program_t *get_ir_program() {
   return program;
 }
@@ -66,13 +94,13 @@ static int strsame(const char *s1, const char *s2) {
 
 void init_ir_program() {
   assert(program == NULL);
-  program = NEW(ir_program, new_list(), 0, 0, new_hmap(strsame, NULL, strhash, 0), NULL);
+  program = NEW(ir_program, new_list(), 0, 0, new_hmap(strsame, NULL, strhash, NULL, 0), NULL, 1);
 }
 
 void add_cfg(ir_func_t *func) {
   ir_cfg_t *cfg = NEW(ir_cfg, func->func, program->cfgs->size, 1, 
     new_list(), new_list(), NULL, 
-    new_hmap(same_ir_arth, same_iropr, hash_ir_arth, 0), NULL);
+    new_hmap(same_ir_arth, same_iropr, hash_ir_arth, hash_iropr, 0), NULL);
   list_append(cfg->irs, func);
   list_append(program->cfgs, cfg);
   hmap_put(program->func_table, func->func, cfg);
@@ -151,6 +179,124 @@ void *ir_visit(void *visitor, void *ir) {
   return f(visitor, ir);
 }
 
+typedef struct ir_opr_walk {
+  void **table;
+  void (*func)(void *, iropr_t **, opr_role_t);
+  void *ctx;
+} ir_opr_walk_t;
+
+#define OPR(opr, role) v->func(v->ctx, (iropr_t **)&(opr), role)
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_nop) {
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_label) {
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_func) {
+  for (iropr_vars_t *l = n->params; l; l = l->next) {
+    OPR(l->opr, E_opr_def);
+  }
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_mov) {
+  OPR(n->lhs, E_opr_def);
+  OPR(n->rhs, E_opr_use);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_arth) {
+  OPR(n->lhs, E_opr_def);
+  OPR(n->opr1, E_opr_use);
+  OPR(n->opr2, E_opr_use);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_set) {
+  OPR(n->lhs, E_opr_def);
+  OPR(n->opr1, E_opr_use);
+  OPR(n->opr2, E_opr_use);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_addr) {
+  OPR(n->lhs, E_opr_def);
+  OPR(n->rhs, E_opr_mem);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_load) {
+  OPR(n->lhs, E_opr_def);
+  OPR(n->rhs, E_opr_ptr);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_store) {
+  OPR(n->lhs, E_opr_ptr);
+  OPR(n->rhs, E_opr_use);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_memcpy) {
+  OPR(n->lhs, E_opr_ptr);
+  OPR(n->rhs, E_opr_ptr);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_goto) {
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_branch) {
+  OPR(n->opr1, E_opr_use);
+  OPR(n->opr2, E_opr_use);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_ret) {
+  OPR(n->opr, E_opr_use);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_alloc) {
+  OPR(n->opr, E_opr_mem);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_call) {
+  OPR(n->ret, E_opr_def);
+  for (iroprs_t *l = n->args; l; l = l->next) {
+    OPR(l->opr, E_opr_use);
+  }
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_read) {
+  OPR(n->opr, E_opr_def);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_opr_walk, ir_write) {
+  OPR(n->opr, E_opr_use);
+  return NULL;
+}
+
+#undef OPR
+
+#define IR_OPR_WALK_FUNC(name, ...) ir_opr_walk_##name,
+
+static ir_visitor_table_t ir_opr_walk_table = {
+  IRALL(IR_OPR_WALK_FUNC)
+};
+
+void ir_opr_walk(ir_t *ir, void *func, void *ctx) {
+  ir_opr_walk_t visitor = {ir_opr_walk_table, func, ctx};
+  ir_visit(&visitor, ir);
+}
+
 void ir_hole(void (*hole_func)(ir_t **), int n) {
   assert(n >= 1);
   LIST(ir_cfg_t*) *cfgs = program->cfgs;
@@ -248,6 +394,10 @@ static void build_bb(ir_cfg_t *cfg) {
   }
 }
 
+static void mark_dirty(ir_bb_t *bb) {
+  bb->dirty = ++program->stamp;
+}
+
 static void check_cfg_reachable(ir_cfg_t *cfg) {
   LIST(ir_bb_t*) *bbs = cfg->bbs;
   if (cfg->worklist == NULL) {
@@ -283,15 +433,8 @@ static void check_cfg_reachable(ir_cfg_t *cfg) {
   for (int i = 0; i < bbs->size; ++i) {
     ir_bb_t *bb = bbs->array[i];
     if (!bb->reachable) {
-      int st = bb->range.start, ed = bb->range.end - 1;
-      for (int i = st; i < ed; ++i) {
-        ((ir_t *)(cfg->irs->array[i]))->irid = E_ir_nop;
-      }
-      ir_t *ir = cfg->irs->array[ed];
-      if (ir->irid == E_ir_branch || ir->irid == E_ir_goto) {
-        remove_branch_goto(ir);
-      } else {
-        ir->irid = E_ir_nop;
+      for (int i = bb->range.start; i < bb->range.end; ++i) {
+        ir_remove(cfg, i);
       }
     } else {
       for (int j = 0; j < bb->outs->size; ++j) {
@@ -302,44 +445,210 @@ static void check_cfg_reachable(ir_cfg_t *cfg) {
   }
 }
 
+// successors implied by the last instruction of bb
+static int bb_succs(ir_cfg_t *cfg, ir_bb_t *bb, ir_bb_t **succ) {
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  ir_t *last = cfg->irs->array[bb->range.end - 1];
+  ir_bb_t *next = bb->no + 1 < bbs->size ? bbs->array[bb->no + 1] : NULL;
+  switch (last->irid) {
+  case E_ir_branch:
+    succ[0] = ((ir_branch_t *)last)->label->bb;
+    assert(succ[0]);
+    succ[1] = next;
+    return next ? 2 : 1;
+  case E_ir_goto:
+    succ[0] = ((ir_goto_t *)last)->label->bb;
+    assert(succ[0]);
+    return 1;
+  case E_ir_ret:
+    succ[0] = cfg->exit;
+    return 1;
+  default:
+    succ[0] = next;
+    return next ? 1 : 0;
+  }
+}
+
+static ir_bb_t *nth_out(ir_bb_t *bb, int n) {
+  return n < bb->outs->size ? bb->outs->array[n] : NULL;
+}
+
 void build_cfg(ir_cfg_t *cfg) {
   LIST(ir_bb_t*) *bbs = cfg->bbs;
+  // old successors and reachability, to mark the blocks whose meets change
+  ir_bb_t **old = malloc(bbs->size * 2 * sizeof(ir_bb_t *));
+  char *was = malloc(bbs->size);
   for (int i = 0; i < bbs->size; ++i) {
     ir_bb_t *bb = bbs->array[i];
+    assert(bb->outs->size <= 2);
+    old[2 * i] = nth_out(bb, 0);
+    old[2 * i + 1] = nth_out(bb, 1);
+    was[i] = bb->reachable;
     list_clear(bb->ins);
     list_clear(bb->outs);
   }
   list_clear(cfg->exit->ins);
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i], *succ[2];
+    int n = bb_succs(cfg, bb, succ);
+    for (int j = 0; j < n; ++j) {
+      list_append(bb->outs, succ[j]);
+      list_append(succ[j]->ins, bb);
+    }
+  }
+  check_cfg_reachable(cfg);
   for (int i = 0; i < bbs->size; ++i) {
     ir_bb_t *bb = bbs->array[i];
-    ir_t *last = cfg->irs->array[bb->range.end - 1];
-    switch (last->irid) {
-    case E_ir_branch: ;
-      ir_branch_t *irb = (ir_branch_t *)last;
-      ir_label_t *blabel = irb->label;
-      assert(blabel->bb);
-      list_append(bb->outs, blabel->bb);
-      list_append(blabel->bb->ins, bb);
-    default:
-      if (i + 1 < bbs->size) {
-        ir_bb_t *bbnext = bbs->array[i + 1];
-        list_append(bb->outs, bbnext);
-        list_append(bbnext->ins, bb);
+    if (!was[i] && !bb->reachable) continue;
+    if (was[i] == bb->reachable && old[2 * i] == nth_out(bb, 0) && 
+        old[2 * i + 1] == nth_out(bb, 1)) continue;
+    mark_dirty(bb);
+    for (int j = 0; j < 2; ++j) {
+      if (old[2 * i + j]) mark_dirty(old[2 * i + j]);
+      if (nth_out(bb, j)) mark_dirty(nth_out(bb, j));
+    }
+  }
+  free(was);
+  free(old);
+  ir_du_build(cfg);
+}
+
+static bitset_t *clean_bitset(bitset_t *bs, int n) {
+  if (bs == NULL) return new_bitset(n, 0);
+  bitset_resize(bs, n);
+  bitset_zero(bs);
+  return bs;
+}
+
+static void check_exit_reachable(ir_cfg_t *cfg) {
+  ir_bb_t *exit = cfg->exit;
+  exit->reachable = 0;
+  for (int j = 0; j < exit->ins->size; ++j) {
+    if (((ir_bb_t *)exit->ins->array[j])->reachable) exit->reachable = 1;
+  }
+}
+
+static bitset_t *cand, *alive;
+
+// to lost a reachable predecessor.  Of the blocks reachable from to, those
+// that still have a reachable predecessor outside that set, and whatever
+// they reach, stay; the others die and their code is removed.
+static void edge_lost(ir_cfg_t *cfg, ir_bb_t *to) {
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  worklist_t *wl = cfg->worklist;
+  cand = clean_bitset(cand, bbs->size);
+  alive = clean_bitset(alive, bbs->size);
+  bitset_set(cand, to->no);
+  worklist_add(wl, to->no);
+  while (!worklist_empty(wl)) {
+    ir_bb_t *bb = bbs->array[worklist_pop(wl)];
+    for (int j = 0; j < bb->outs->size; ++j) {
+      ir_bb_t *out = bb->outs->array[j];
+      if (out == cfg->exit || !out->reachable || bitset_test(cand, out->no)) {
+        continue;
       }
-      break;
-    case E_ir_goto: ;
-      ir_goto_t *irg = (ir_goto_t *)last;
-      ir_label_t *glabel = irg->label;
-      assert(glabel->bb);
-      list_append(bb->outs, glabel->bb);
-      list_append(glabel->bb->ins, bb);
-      break;
-    case E_ir_ret: 
-      list_append(bb->outs, cfg->exit);
-      list_append(cfg->exit->ins, bb);
+      bitset_set(cand, out->no);
+      worklist_add(wl, out->no);
+    }
+  }
+  for (int i = bitset_next(cand, 0); i >= 0; i = bitset_next(cand, i + 1)) {
+    ir_bb_t *bb = bbs->array[i];
+    int root = i == 0;
+    for (int j = 0; j < bb->ins->size && !root; ++j) {
+      ir_bb_t *in = bb->ins->array[j];
+      root = in->reachable && !bitset_test(cand, in->no);
+    }
+    if (root) {
+      bitset_set(alive, i);
+      worklist_add(wl, i);
+    }
+  }
+  while (!worklist_empty(wl)) {
+    ir_bb_t *bb = bbs->array[worklist_pop(wl)];
+    for (int j = 0; j < bb->outs->size; ++j) {
+      ir_bb_t *out = bb->outs->array[j];
+      if (out == cfg->exit || !bitset_test(cand, out->no) || 
+          bitset_test(alive, out->no)) continue;
+      bitset_set(alive, out->no);
+      worklist_add(wl, out->no);
+    }
+  }
+  bitset_andnot(cand, alive);
+  if (bitset_next(cand, 0) < 0) return;
+  for (int i = bitset_next(cand, 0); i >= 0; i = bitset_next(cand, i + 1)) {
+    ir_bb_t *bb = bbs->array[i];
+    bb->reachable = 0;
+    mark_dirty(bb);
+    for (int j = 0; j < bb->outs->size; ++j) {
+      mark_dirty(bb->outs->array[j]);
+    }
+  }
+  // the removals only unlink edges out of dead blocks, which cannot recurse
+  for (int i = bitset_next(cand, 0); i >= 0; i = bitset_next(cand, i + 1)) {
+    ir_bb_t *bb = bbs->array[i];
+    for (int k = bb->range.start; k < bb->range.end; ++k) {
+      ir_remove(cfg, k);
     }
   }
-  check_cfg_reachable(cfg);
+}
+
+void ir_edge_add(ir_cfg_t *cfg, ir_bb_t *from, ir_bb_t *to) {
+  list_append(from->outs, to);
+  list_append(to->ins, from);
+  mark_dirty(from);
+  mark_dirty(to);
+  if (!from->reachable || to->reachable) return;
+  to->reachable = 1;
+  if (to == cfg->exit) return;
+  worklist_t *wl = cfg->worklist;
+  worklist_add(wl, to->no);
+  while (!worklist_empty(wl)) {
+    ir_bb_t *bb = cfg->bbs->array[worklist_pop(wl)];
+    for (int j = 0; j < bb->outs->size; ++j) {
+      ir_bb_t *out = bb->outs->array[j];
+      if (out->reachable) continue;
+      out->reachable = 1;
+      mark_dirty(out);
+      if (out != cfg->exit) worklist_add(wl, out->no);
+    }
+  }
+}
+
+void ir_edge_remove(ir_cfg_t *cfg, ir_bb_t *from, ir_bb_t *to) {
+  int found = list_remove(from->outs, to);
+  found &= list_remove(to->ins, from);
+  assert(found);
+  mark_dirty(from);
+  mark_dirty(to);
+  if (to == cfg->exit) {
+    check_exit_reachable(cfg);
+  } else if (from->reachable && to->reachable) {
+    edge_lost(cfg, to);
+  }
+}
+
+// brings bb->outs in line with the last instruction of bb
+static void bb_relink(ir_cfg_t *cfg, ir_bb_t *bb) {
+  ir_bb_t *succ[2], *stale[2];
+  int n = bb_succs(cfg, bb, succ), kept[2] = {0, 0}, nstale = 0;
+  for (int j = 0; j < bb->outs->size; ++j) {
+    ir_bb_t *out = bb->outs->array[j];
+    int k = 0;
+    while (k < n && (kept[k] || succ[k] != out)) k++;
+    if (k < n) {
+      kept[k] = 1;
+    } else {
+      assert(nstale < 2);
+      stale[nstale++] = out;
+    }
+  }
+  // add first, so that a block reached both ways never looks dead
+  for (int k = 0; k < n; ++k) {
+    if (!kept[k]) ir_edge_add(cfg, bb, succ[k]);
+  }
+  for (int j = 0; j < nstale; ++j) {
+    ir_edge_remove(cfg, bb, stale[j]);
+  }
 }
 
 void build_program() {
@@ -352,6 +661,600 @@ void build_program() {
   check_program_reachable();
 }
 
+// replaces the code of cfg by irs: drops the per-instruction facts tied to
+// the old layout and rebuilds the blocks and edges
+void ir_rebuild_cfg(ir_cfg_t *cfg, LIST(ir_t*) *irs) {
+  cfg->code.valid = 0;
+  ir_livevar_res_t *lv = &cfg->livevar_res;
+  if (lv->res) {
+    // the in of a non-first slot is the out of the one before
+    for (int k = 0; k <= cfg->irs->size; ++k) {
+      bitset_t *in = lv->res[k].in;
+      if (in && (k == 0 || lv->res[k - 1].out != in)) {
+        free(in->array);
+        free(in);
+      }
+    }
+    for (int k = 0; k < cfg->irs->size; ++k) {
+      if (lv->res[k].out == NULL) continue;
+      free(lv->res[k].out->array);
+      free(lv->res[k].out);
+    }
+    free(lv->res);
+    free(lv->cross_call->array);
+    free(lv->cross_call);
+    free(lv->buf->array);
+    free(lv->buf);
+    free(lv->worklist);
+    lv->res = NULL;
+  }
+  ir_arthprog_res_t *ap = &cfg->arthprog_res;
+  if (ap->res) {
+    free(ap->res);
+    free(ap->worklist);
+    ap->res = NULL;
+  }
+  free(cfg->worklist);
+  cfg->worklist = NULL;
+  cfg->irs->size = 0;
+  for (int i = 0; i < irs->size; ++i) list_append(cfg->irs, irs->array[i]);
+  list_clear(cfg->bbs);
+  build_bb(cfg);
+  build_cfg(cfg);
+}
+
+static iropr_code_t code_opr(ir_code_t *code, iropr_t *opr) {
+  if (opr->oprid == E_iropr_var) {
+    return (iropr_code_t)((iropr_var_t *)opr)->id << 1;
+  }
+  int val = ((iropr_imm_t *)opr)->val;
+  if (val >= -(1 << 29) && val < (1 << 29)) {
+    return ((iropr_code_t)val << 2) | 1;
+  }
+  if (code->imm_num == code->imm_cap) {
+    code->imm_cap = code->imm_cap ? code->imm_cap * 2 : 8;
+    code->imms = realloc(code->imms, code->imm_cap * sizeof(int));
+  }
+  code->imms[code->imm_num] = val;
+  return ((iropr_code_t)(code->imm_num++) << 2) | 3;
+}
+
+int oprc_imm(ir_code_t *code, iropr_code_t opr) {
+  assert(OPRC_IS_IMM(opr));
+  if ((opr & 3) == 1) return (int32_t)opr >> 2;
+  return code->imms[opr >> 2];
+}
+
+static void code_ext(ir_code_t *code, iropr_code_t opr) {
+  if (code->ext_num == code->ext_cap) {
+    code->ext_cap = code->ext_cap ? code->ext_cap * 2 : 16;
+    code->ext = realloc(code->ext, code->ext_cap * sizeof(iropr_code_t));
+  }
+  code->ext[code->ext_num++] = opr;
+}
+
+static void code_encode(ir_code_t *code, int i, ir_t *ir) {
+  iropr_code_t *o = code->opr[i];
+  code->op[i] = ir->irid;
+  code->sub[i] = 0;
+  o[0] = o[1] = o[2] = OPRC_NONE;
+  switch (ir->irid) {
+  case E_ir_func: ;
+    ir_func_t *func = (ir_func_t *)ir;
+    o[1] = code->ext_num;
+    for (iropr_vars_t *l = func->params; l; l = l->next) {
+      code_ext(code, code_opr(code, (iropr_t *)l->opr));
+    }
+    o[2] = code->ext_num - o[1];
+    break;
+  case E_ir_mov: ;
+    ir_mov_t *mov = (ir_mov_t *)ir;
+    o[0] = code_opr(code, (iropr_t *)mov->lhs);
+    o[1] = code_opr(code, mov->rhs);
+    break;
+  case E_ir_arth: ;
+    ir_arth_t *arth = (ir_arth_t *)ir;
+    code->sub[i] = arth->op;
+    o[0] = code_opr(code, (iropr_t *)arth->lhs);
+    o[1] = code_opr(code, arth->opr1);
+    o[2] = code_opr(code, arth->opr2);
+    break;
+  case E_ir_set: ;
+    ir_set_t *set = (ir_set_t *)ir;
+    code->sub[i] = set->op;
+    o[0] = code_opr(code, (iropr_t *)set->lhs);
+    o[1] = code_opr(code, set->opr1);
+    o[2] = code_opr(code, set->opr2);
+    break;
+  case E_ir_addr: ;
+    ir_addr_t *addr = (ir_addr_t *)ir;
+    o[0] = code_opr(code, (iropr_t *)addr->lhs);
+    o[1] = code_opr(code, (iropr_t *)addr->rhs);
+    break;
+  case E_ir_load: ;
+    ir_load_t *load = (ir_load_t *)ir;
+    o[0] = code_opr(code, (iropr_t *)load->lhs);
+    o[1] = code_opr(code, (iropr_t *)load->rhs);
+    break;
+  case E_ir_store: ;
+    ir_store_t *store = (ir_store_t *)ir;
+    o[1] = code_opr(code, (iropr_t *)store->lhs);
+    o[2] = code_opr(code, store->rhs);
+    break;
+  case E_ir_memcpy: ;
+    ir_memcpy_t *copy = (ir_memcpy_t *)ir;
+    o[1] = code_opr(code, (iropr_t *)copy->lhs);
+    o[2] = code_opr(code, (iropr_t *)copy->rhs);
+    break;
+  case E_ir_branch: ;
+    ir_branch_t *branch = (ir_branch_t *)ir;
+    code->sub[i] = branch->op;
+    o[1] = code_opr(code, branch->opr1);
+    o[2] = code_opr(code, branch->opr2);
+    break;
+  case E_ir_ret:
+    o[1] = code_opr(code, ((ir_ret_t *)ir)->opr);
+    break;
+  case E_ir_alloc:
+    o[0] = code_opr(code, (iropr_t *)((ir_alloc_t *)ir)->opr);
+    break;
+  case E_ir_call: ;
+    ir_call_t *call = (ir_call_t *)ir;
+    o[0] = code_opr(code, (iropr_t *)call->ret);
+    o[1] = code->ext_num;
+    for (iroprs_t *l = call->args; l; l = l->next) {
+      code_ext(code, code_opr(code, l->opr));
+    }
+    o[2] = code->ext_num - o[1];
+    break;
+  case E_ir_read:
+    o[0] = code_opr(code, (iropr_t *)((ir_read_t *)ir)->opr);
+    break;
+  case E_ir_write:
+    o[1] = code_opr(code, ((ir_write_t *)ir)->opr);
+    break;
+  default: ;
+  }
+}
+
+// brings cfg->code up to date with cfg->irs: the blocks changed since the
+// last build are encoded again, and everything once the pools hold as many
+// stale entries as live ones
+void ir_code_build(ir_cfg_t *cfg) {
+  LIST(ir_t*) *irs = cfg->irs;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  ir_code_t *code = &cfg->code;
+  if (code->valid && code->ext_num + code->imm_num <= 2 * code->pool + 64) {
+    assert(code->size == irs->size);
+    for (int b = 0; b < bbs->size; ++b) {
+      ir_bb_t *bb = bbs->array[b];
+      if (bb->dirty <= code->stamp) continue;
+      for (int i = bb->range.start; i < bb->range.end; ++i) {
+        code_encode(code, i, irs->array[i]);
+      }
+    }
+  } else {
+    if (code->cap < irs->size) {
+      code->cap = irs->size;
+      code->op = realloc(code->op, code->cap);
+      code->sub = realloc(code->sub, code->cap);
+      code->opr = realloc(code->opr, code->cap * sizeof(code->opr[0]));
+    }
+    code->size = irs->size;
+    code->ext_num = code->imm_num = 0;
+    for (int i = 0; i < irs->size; ++i) code_encode(code, i, irs->array[i]);
+    code->pool = code->ext_num + code->imm_num;
+  }
+  code->valid = 1;
+  code->stamp = program->stamp;
+}
+
+typedef struct ir_du_ctx {
+  ir_du_t *du;
+  int index, fill;
+} ir_du_ctx_t;
+
+static void du_add(ir_du_ctx_t *c, iropr_t **opr, opr_role_t role) {
+  if ((*opr)->oprid != E_iropr_var) return;
+  ir_du_t *du = c->du;
+  int id = ((iropr_var_t *)*opr)->id;
+  switch (role) {
+  case E_opr_def:
+    if (c->fill) {
+      du->def[du->def_start[id] + du->def_num[id]++] = c->index;
+    } else {
+      du->def_start[id + 1]++;
+    }
+    break;
+  case E_opr_use:
+  case E_opr_ptr:
+    if (c->fill) {
+      du->use[du->use_start[id] + du->use_num[id]++] = c->index;
+    } else {
+      du->use_start[id + 1]++;
+    }
+    break;
+  case E_opr_mem:
+    du->mem[id] = 1;
+    break;
+  }
+}
+
+static void du_unlink(ir_du_t *du, iropr_t **opr, opr_role_t role) {
+  if ((*opr)->oprid != E_iropr_var) return;
+  int id = ((iropr_var_t *)*opr)->id;
+  if (id >= du->var_num) return;
+  if (role == E_opr_def) {
+    du->def_num[id]--;
+  } else if (role != E_opr_mem) {
+    du->use_num[id]--;
+  }
+}
+
+// re-count an occurrence of the new instruction at index c->index; this only
+// works if the chains already list that index for the var
+static void du_relink(ir_du_ctx_t *c, iropr_t **opr, opr_role_t role) {
+  if ((*opr)->oprid != E_iropr_var || role == E_opr_mem) return;
+  ir_du_t *du = c->du;
+  int id = ((iropr_var_t *)*opr)->id;
+  if (id >= du->var_num) {
+    du->valid = 0;
+    return;
+  }
+  int *list = role == E_opr_def ? du->def : du->use;
+  int *start = role == E_opr_def ? du->def_start : du->use_start;
+  for (int k = start[id]; k < start[id + 1]; ++k) {
+    if (list[k] == c->index) {
+      if (role == E_opr_def) {
+        du->def_num[id]++;
+      } else {
+        du->use_num[id]++;
+      }
+      return;
+    }
+  }
+  du->valid = 0;
+}
+
+void ir_du_build(ir_cfg_t *cfg) {
+  LIST(ir_t*) *irs = cfg->irs;
+  ir_du_t *du = &cfg->du;
+  int n = program->var_num;
+  if (du->cap < n) {
+    du->cap = n;
+    du->def_start = realloc(du->def_start, (n + 1) * sizeof(int));
+    du->use_start = realloc(du->use_start, (n + 1) * sizeof(int));
+    du->def_num = realloc(du->def_num, n * sizeof(int));
+    du->use_num = realloc(du->use_num, n * sizeof(int));
+    du->mem = realloc(du->mem, n);
+  }
+  du->var_num = n;
+  memset(du->def_start, 0, (n + 1) * sizeof(int));
+  memset(du->use_start, 0, (n + 1) * sizeof(int));
+  memset(du->def_num, 0, n * sizeof(int));
+  memset(du->use_num, 0, n * sizeof(int));
+  memset(du->mem, 0, n);
+  ir_du_ctx_t c = {du, 0, 0};
+  for (c.index = 0; c.index < irs->size; ++c.index) {
+    ir_opr_walk(irs->array[c.index], du_add, &c);
+  }
+  for (int i = 0; i < n; ++i) {
+    du->def_start[i + 1] += du->def_start[i];
+    du->use_start[i + 1] += du->use_start[i];
+  }
+  if (du->def_cap < du->def_start[n]) {
+    du->def_cap = du->def_start[n];
+    du->def = realloc(du->def, du->def_cap * sizeof(int));
+  }
+  if (du->use_cap < du->use_start[n]) {
+    du->use_cap = du->use_start[n];
+    du->use = realloc(du->use, du->use_cap * sizeof(int));
+  }
+  c.fill = 1;
+  for (c.index = 0; c.index < irs->size; ++c.index) {
+    ir_opr_walk(irs->array[c.index], du_add, &c);
+  }
+  du->valid = 1;
+}
+
+static int dom_intersect(ir_dom_t *dom, int a, int b) {
+  while (a != b) {
+    while (dom->rpo_no[a] > dom->rpo_no[b]) a = dom->idom[a];
+    while (dom->rpo_no[b] > dom->rpo_no[a]) b = dom->idom[b];
+  }
+  return a;
+}
+
+// Loop nesting depth: a block is in the natural loop of header h when it
+// reaches a back edge into h without passing h.
+static void ir_dom_loops(ir_cfg_t *cfg) {
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  ir_dom_t *dom = &cfg->dom;
+  int n = bbs->size, *stack = malloc(n * sizeof(int)), *mark = malloc(n * sizeof(int));
+  memset(dom->depth, 0, n * sizeof(int));
+  memset(mark, 0xff, n * sizeof(int));
+  for (int i = 0; i < dom->rpo_num; ++i) {
+    ir_bb_t *h = bbs->array[dom->rpo[i]];
+    int sp = 0;
+    for (int j = 0; j < h->ins->size; ++j) {
+      ir_bb_t *in = h->ins->array[j];
+      if (dom->rpo_no[in->no] < 0 || !ir_dominates(dom, h->no, in->no)) continue;
+      if (mark[in->no] != h->no) {
+        mark[in->no] = h->no;
+        stack[sp++] = in->no;
+      }
+    }
+    if (sp == 0) continue;
+    mark[h->no] = h->no;
+    dom->depth[h->no]++;
+    while (sp > 0) {
+      ir_bb_t *bb = bbs->array[stack[--sp]];
+      if (bb == h) continue;
+      dom->depth[bb->no]++;
+      for (int j = 0; j < bb->ins->size; ++j) {
+        ir_bb_t *in = bb->ins->array[j];
+        if (dom->rpo_no[in->no] < 0 || mark[in->no] == h->no) continue;
+        mark[in->no] = h->no;
+        stack[sp++] = in->no;
+      }
+    }
+  }
+  free(mark);
+  free(stack);
+}
+
+// Cooper, Harvey and Kennedy's iterative scheme over reverse postorder.
+void ir_dom_build(ir_cfg_t *cfg) {
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  ir_dom_t *dom = &cfg->dom;
+  int n = bbs->size;
+  if (dom->cap < n) {
+    dom->cap = n;
+    dom->idom = realloc(dom->idom, n * sizeof(int));
+    dom->rpo = realloc(dom->rpo, n * sizeof(int));
+    dom->rpo_no = realloc(dom->rpo_no, n * sizeof(int));
+    dom->kid_start = realloc(dom->kid_start, (n + 1) * sizeof(int));
+    dom->kid = realloc(dom->kid, n * sizeof(int));
+    dom->pre = realloc(dom->pre, n * sizeof(int));
+    dom->post = realloc(dom->post, n * sizeof(int));
+    dom->depth = realloc(dom->depth, n * sizeof(int));
+  }
+  // postorder by an explicit dfs; pre doubles as the edge cursor
+  int *stack = dom->kid, sp = 0, num = 0;
+  memset(dom->rpo_no, 0xff, n * sizeof(int));
+  memset(dom->idom, 0xff, n * sizeof(int));
+  dom->rpo_no[0] = 0;
+  dom->pre[0] = 0;
+  stack[sp++] = 0;
+  while (sp > 0) {
+    ir_bb_t *bb = bbs->array[stack[sp - 1]];
+    if (dom->pre[bb->no] < bb->outs->size) {
+      ir_bb_t *out = bb->outs->array[dom->pre[bb->no]++];
+      if (out != cfg->exit && out->reachable && dom->rpo_no[out->no] < 0) {
+        dom->rpo_no[out->no] = 0;
+        dom->pre[out->no] = 0;
+        stack[sp++] = out->no;
+      }
+    } else {
+      dom->post[num++] = bb->no;
+      sp--;
+    }
+  }
+  dom->rpo_num = num;
+  for (int i = 0; i < num; ++i) {
+    dom->rpo[i] = dom->post[num - 1 - i];
+    dom->rpo_no[dom->rpo[i]] = i;
+  }
+  dom->idom[0] = 0;
+  for (int changed = 1; changed; ) {
+    changed = 0;
+    for (int i = 1; i < num; ++i) {
+      ir_bb_t *bb = bbs->array[dom->rpo[i]];
+      int idom = -1;
+      for (int j = 0; j < bb->ins->size; ++j) {
+        ir_bb_t *in = bb->ins->array[j];
+        if (dom->idom[in->no] < 0) continue;
+        idom = idom < 0 ? in->no : dom_intersect(dom, in->no, idom);
+      }
+      if (idom != dom->idom[bb->no]) {
+        dom->idom[bb->no] = idom;
+        changed = 1;
+      }
+    }
+  }
+  dom->idom[0] = -1;
+  memset(dom->kid_start, 0, (n + 1) * sizeof(int));
+  for (int i = 1; i < num; ++i) {
+    dom->kid_start[dom->idom[dom->rpo[i]] + 1]++;
+  }
+  for (int b = 0; b < n; ++b) {
+    dom->kid_start[b + 1] += dom->kid_start[b];
+  }
+  // fill in rpo order, using post as the per-parent cursor
+  memcpy(dom->post, dom->kid_start, n * sizeof(int));
+  for (int i = 1; i < num; ++i) {
+    int b = dom->rpo[i];
+    dom->kid[dom->post[dom->idom[b]]++] = b;
+  }
+  // pre / post numbers by a dfs on the tree that climbs back through idom,
+  // with post doubling as the child cursor until the node is left
+  int clock = 0, b = 0;
+  int *cursor = dom->post;
+  memcpy(cursor, dom->kid_start, n * sizeof(int));
+  dom->pre[0] = clock++;
+  while (b >= 0) {
+    if (cursor[b] < dom->kid_start[b + 1]) {
+      int k = dom->kid[cursor[b]++];
+      dom->pre[k] = clock++;
+      b = k;
+    } else {
+      int up = dom->idom[b];
+      cursor[b] = clock++; // post number, the cursor is no longer needed
+      b = up;
+    }
+  }
+  ir_dom_loops(cfg);
+}
+
+// a dominates b, both reachable
+int ir_dominates(ir_dom_t *dom, int a, int b) {
+  return dom->pre[a] <= dom->pre[b] && dom->post[b] <= dom->post[a];
+}
+
+static int is_jump(ir_t *ir) {
+  return ir->irid == E_ir_goto || ir->irid == E_ir_branch || ir->irid == E_ir_ret;
+}
+
+void ir_remove(ir_cfg_t *cfg, int i) {
+  ir_t *ir = cfg->irs->array[i];
+  if (ir->irid == E_ir_nop) return;
+  int jump = is_jump(ir);
+  ir_dirty(cfg, i);
+  if (cfg->du.valid) {
+    ir_opr_walk(ir, du_unlink, &cfg->du);
+  }
+  if (ir->irid == E_ir_goto || ir->irid == E_ir_branch) {
+    remove_branch_goto(ir);
+  } else {
+    ir->irid = E_ir_nop;
+  }
+  if (jump) bb_relink(cfg, ir_bb_of(cfg, i));
+}
+
+// label refs of gotos / branches are left to the caller
+void ir_replace(ir_cfg_t *cfg, int i, ir_t *ir) {
+  ir_dirty(cfg, i);
+  if (cfg->du.valid) {
+    ir_du_ctx_t c = {&cfg->du, i, 1};
+    ir_opr_walk(cfg->irs->array[i], du_unlink, &cfg->du);
+    ir_opr_walk(ir, du_relink, &c);
+  }
+  int jump = is_jump(cfg->irs->array[i]) || is_jump(ir);
+  cfg->irs->array[i] = ir;
+  if (jump) bb_relink(cfg, ir_bb_of(cfg, i));
+}
+
+// operands of instruction i were rewritten in place
+void ir_touch(ir_cfg_t *cfg, int i) {
+  ir_dirty(cfg, i);
+  cfg->du.valid = 0;
+}
+
+// block holding instruction i
+ir_bb_t *ir_bb_of(ir_cfg_t *cfg, int i) {
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  int lo = 0, hi = bbs->size - 1;
+  assert(hi >= 0);
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (((ir_bb_t *)bbs->array[mid])->range.start <= i) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return bbs->array[lo];
+}
+
+// instruction i changed, the facts of its block are stale
+void ir_dirty(ir_cfg_t *cfg, int i) {
+  mark_dirty(ir_bb_of(cfg, i));
+}
+
+// ir_df_bs_t and ir_df_map_t share this layout
+typedef struct ir_df_slot { void *in, *out; } ir_df_slot_t;
+
+static void *compact_df(ir_cfg_t *cfg, void *df, range_t *old, int *pre, int size) {
+  if (df == NULL) return NULL;
+  ir_df_slot_t *res = df, *nres = calloc(size + 1, sizeof(ir_df_slot_t));
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i];
+    int st = old[i].start, ed = old[i].end;
+    if (res[st].in == NULL) continue;
+    nres[bb->range.start].in = res[st].in;
+    for (int k = st; k < ed; ++k) {
+      if (pre[k + 1] == pre[k]) continue;
+      nres[pre[k]].out = res[k].out;
+      if (pre[k] + 1 < bb->range.end) nres[pre[k] + 1].in = res[k].out;
+    }
+  }
+  nres[size] = res[cfg->irs->size];
+  free(res);
+  return nres;
+}
+
+// the pools stay as they are, the slots move with their instructions
+static void compact_code(ir_code_t *code, char *keep, int *pre, int n) {
+  assert(code->size == n);
+  for (int i = 0; i < n; ++i) {
+    if (!keep[i]) continue;
+    code->op[pre[i]] = code->op[i];
+    code->sub[pre[i]] = code->sub[i];
+    memcpy(code->opr[pre[i]], code->opr[i], sizeof(code->opr[0]));
+  }
+  code->size = pre[n];
+}
+
+static int ir_compact_cfg(ir_cfg_t *cfg) {
+  LIST(ir_t*) *irs = cfg->irs;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  assert(irs->size > 0 && bbs->size > 0);
+  int *pre = malloc((irs->size + 1) * sizeof(int));
+  char *keep = malloc(irs->size);
+  range_t *old = malloc(bbs->size * sizeof(range_t));
+  for (int i = 0; i < irs->size; ++i) {
+    keep[i] = ((ir_t *)(irs->array[i]))->irid != E_ir_nop;
+  }
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i];
+    int st = bb->range.start, ed = bb->range.end, k = st;
+    while (k < ed && !keep[k]) ++k;
+    // every block keeps at least its last slot so ranges stay non-empty
+    if (k == ed) keep[ed - 1] = 1;
+    old[i] = bb->range;
+  }
+  int size = 0;
+  for (int i = 0; i < irs->size; ++i) {
+    pre[i] = size;
+    if (keep[i]) irs->array[size++] = irs->array[i];
+  }
+  pre[irs->size] = size;
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i];
+    bb->range = RANGE(pre[bb->range.start], pre[bb->range.end]);
+  }
+  cfg->exit->range = RANGE(size, size);
+  if (cfg->code.valid) compact_code(&cfg->code, keep, pre, irs->size);
+  cfg->livevar_res.res = compact_df(cfg, cfg->livevar_res.res, old, pre, size);
+  cfg->arthprog_res.res = compact_df(cfg, cfg->arthprog_res.res, old, pre, size);
+  int removed = irs->size - size;
+  irs->size = size;
+  if (cfg->du.valid) ir_du_build(cfg);
+  free(old);
+  free(keep);
+  free(pre);
+  return removed;
+}
+
+int ir_compact(int nop_percent) {
+  LIST(ir_cfg_t*) *cfgs = program->cfgs;
+  int removed = 0;
+  for (int i = 0; i < cfgs->size; ++i) {
+    ir_cfg_t *cfg = cfgs->array[i];
+    if (!cfg->reachable) continue;
+    LIST(ir_t*) *irs = cfg->irs;
+    int nops = 0;
+    for (int j = 0; j < irs->size; ++j) {
+      nops += ((ir_t *)(irs->array[j]))->irid == E_ir_nop;
+    }
+    if (nops * 100 > irs->size * nop_percent) {
+      removed += ir_compact_cfg(cfg);
+    }
+  }
+  return removed;
+}
+
 void ir_analyse_cfg(ir_cfg_t *cfg, void (*ana_func)(ir_cfg_t *, ir_bb_t *)) {
   LIST(ir_bb_t*) *bbs = cfg->bbs;
   for (int i = 0; i < bbs->size; ++i) {
@@ -361,26 +1264,51 @@ void ir_analyse_cfg(ir_cfg_t *cfg, void (*ana_func)(ir_cfg_t *, ir_bb_t *)) {
   }
 }
 
+static bitset_t *affected;
+
+// marks the reachable blocks changed after since, plus the blocks whose facts
+// depend on them: successors for forward problems, predecessors otherwise
+static void mark_affected(ir_cfg_t *cfg, int forward, int since) {
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  worklist_t *wl = cfg->worklist;
+  affected = clean_bitset(affected, bbs->size);
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i];
+    if (!bb->reachable || (since && bb->dirty <= since)) continue;
+    bitset_set(affected, i);
+    if (since) worklist_add(wl, i);
+  }
+  while (!worklist_empty(wl)) {
+    ir_bb_t *bb = bbs->array[worklist_pop(wl)];
+    LIST(ir_bb_t*) *deps = forward ? bb->outs : bb->ins;
+    for (int j = 0; j < deps->size; ++j) {
+      ir_bb_t *dep = deps->array[j];
+      if (dep == cfg->exit || !dep->reachable || bitset_test(affected, dep->no)) {
+        continue;
+      }
+      bitset_set(affected, dep->no);
+      worklist_add(wl, dep->no);
+    }
+  }
+}
+
+// Blocks outside the affected set keep the solution computed at since; only
+// the affected ones are reset and queued.
 void ir_iter_cfg(ir_cfg_t *cfg, void *res, worklist_t *wl, 
-  void *meet, void *skip, void *trans, int forward) {
+  void *meet, void *skip, void *trans, void *reset, int forward, int since) {
   LIST(ir_t*) *irs = cfg->irs;
   LIST(ir_bb_t*) *bbs = cfg->bbs;
   void (*meetf)(void *, ir_bb_t *, ir_bb_t *) = meet;
   int (*skipf)(void *, ir_bb_t *) = skip;
   int (*transf)(void *, LIST(ir_t *) *, ir_bb_t *) = trans;
+  void (*resetf)(void *, ir_bb_t *) = reset;
   assert(worklist_empty(wl));
-  if (forward) {
-    for (int i = 0; i < bbs->size; ++i) {
-      ir_bb_t *curr = bbs->array[i];
-      if (!curr->reachable) continue;
-      worklist_add(wl, i);
-    }
-  } else {
-    for (int i = bbs->size - 1; i >= 0; --i) {
-      ir_bb_t *curr = bbs->array[i];
-      if (!curr->reachable) continue;
-      worklist_add(wl, i);
-    }
+  mark_affected(cfg, forward, since);
+  for (int k = 0; k < bbs->size; ++k) {
+    int i = forward ? k : bbs->size - 1 - k;
+    if (!bitset_test(affected, i)) continue;
+    resetf(res, bbs->array[i]);
+    worklist_add(wl, i);
   }
   while (!worklist_empty(wl)) {
     int i = worklist_pop(wl);
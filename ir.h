@@ -24,6 +24,8 @@ typedef struct iropr_vars { iropr_var_t *opr; struct iropr_vars *next; } iropr_v
 int same_iropr(iropr_t *a, iropr_t *b);
 uint64_t hash_iropr(iropr_t *a);
 int is_iropr_imm(iropr_t *opr, int imm);
+int eval_relop(relop_t op, int x, int y);
+int fold_const(op2_t op, int x, int y, int *r);
 
 struct ir_bb;
 
@@ -33,9 +35,11 @@ struct ir_bb;
   _(ir_func, char *func; iropr_vars_t *params) \
   _(ir_mov, iropr_var_t *lhs; iropr_t *rhs) \
   _(ir_arth, iropr_var_t *lhs; iropr_t *opr1, *opr2; op2_t op) \
+  _(ir_set, iropr_var_t *lhs; iropr_t *opr1, *opr2; relop_t op) \
   _(ir_addr, iropr_var_t *lhs, *rhs) \
   _(ir_load, iropr_var_t *lhs, *rhs) \
   _(ir_store, iropr_var_t *lhs; iropr_t *rhs) \
+  _(ir_memcpy, iropr_var_t *lhs, *rhs; int size) \
   _(ir_goto, ir_label_t *label) \
   _(ir_branch, iropr_t *opr1, *opr2; relop_t op; ir_label_t *label) \
   _(ir_ret, iropr_t *opr) \
@@ -63,14 +67,87 @@ uint64_t hash_ir_arth(ir_arth_t *a);
 typedef void *ir_visitor_table_t[E_IRNUM];
 void *ir_visit(void *visitor, void *ir);
 
+typedef enum opr_role { 
+  E_opr_def,  // written
+  E_opr_use,  // read, may be replaced by an immediate
+  E_opr_ptr,  // read, must stay a var (load / store address)
+  E_opr_mem,  // names storage (ir_alloc, rhs of ir_addr)
+} opr_role_t;
+
+// calls func(ctx, &slot, role) for every operand slot of ir
+void ir_opr_walk(ir_t *ir, 
+  void *func, // void func(void *ctx, iropr_t **opr, opr_role_t role);
+  void *ctx);
+
 typedef struct ir_bb {
   ir_label_t *id;
   int no;
   range_t range;
   LIST(ir_bb_t*) *outs, *ins;
   int reachable;
+  int dirty; // program stamp of the last change to the code or edges
 } ir_bb_t;
 
+// cfg->irs as index-aligned arrays; operands are var id << 1 or tagged
+// immediates.  Only dirty blocks are re-encoded, so label slots may be stale
+typedef uint32_t iropr_code_t;
+
+#define OPRC_NONE      ((iropr_code_t)-1)
+#define OPRC_IS_VAR(x) (((x) & 1) == 0)
+#define OPRC_IS_IMM(x) (((x) & 1) == 1 && (x) != OPRC_NONE)
+#define OPRC_VAR(x)    ((int)((x) >> 1))
+
+typedef struct ir_code {
+  uint8_t *op, *sub; // irid; op2_t of arth, relop_t of set and branch
+  // [0] = def, [1], [2] = uses; for ir_func and ir_call, [1], [2] are
+  // start and count of the params / args in ext
+  iropr_code_t (*opr)[3];
+  int size, cap;
+  iropr_code_t *ext;
+  int ext_num, ext_cap;
+  int *imms, imm_num, imm_cap;
+  int valid, stamp; // program stamp of the last build
+  int pool;         // ext_num + imm_num after the last full build
+} ir_code_t;
+
+// Def-use chains by var id; removals only update def_num / use_num, so list
+// entries may be stale and callers re-check irs[i]
+typedef struct ir_du {
+  int valid, var_num;
+  int *def_start, *def; // defs of v: def[def_start[v] .. def_start[v + 1])
+  int *use_start, *use;
+  int *def_num, *use_num;
+  char *mem;            // named by an ir_alloc / ir_addr
+  int cap, def_cap, use_cap;
+} ir_du_t;
+
+// Dominator tree over the reachable blocks, indexed by bb->no.
+typedef struct ir_dom {
+  int *idom;            // -1 for the entry and unreachable blocks
+  int *rpo, rpo_num;    // reachable block nos in reverse postorder
+  int *rpo_no;          // position in rpo, -1 = unreachable
+  int *kid_start, *kid; // children of b: kid[kid_start[b] .. kid_start[b + 1])
+  int *pre, *post;      // dfs numbers on the tree, see ir_dominates
+  int *depth;           // loop nesting depth, 0 = not in a loop
+  int cap;
+} ir_dom_t;
+
+// Flow-insensitive points-to facts for addresses held in vars, indexed by
+// var id.  Objects are named by the var of their ir_alloc / ir_addr; an
+// object escapes once its address may be reached through an untracked
+// pointer.  Accesses are assumed to be 4-byte words.
+#define PT_NONE (-1) // not an address seen so far
+#define PT_ANY  (-2) // may point to any escaped object
+#define OFF_ANY INT32_MIN
+
+typedef enum alias { E_alias_no, E_alias_may, E_alias_must } alias_t;
+
+typedef struct ir_alias {
+  int *obj, *off; // points into obj at byte off, or PT_NONE / PT_ANY
+  char *escaped;  // indexed by the var id of the object
+  int cap;
+} ir_alias_t;
+
 typedef struct ir_cfg {
   char *name;
   int no, reachable;
@@ -79,6 +156,10 @@ typedef struct ir_cfg {
   ir_bb_t *exit;
   HMAP(ir_arth_t *, iropr_var_t *) *expr_map;
   worklist_t *worklist;
+  ir_code_t code;
+  ir_du_t du;
+  ir_dom_t dom;
+  ir_alias_t alias;
   ir_livevar_res_t livevar_res;
   ir_avexpr_res_t avexpr_res;
   ir_constant_res_t constant_res;
@@ -91,6 +172,7 @@ typedef struct ir_program {
   int var_num, label_num;
   HMAP(const char *, ir_cfg_t *) *func_table;
   worklist_t *worklist;
+  int stamp; // bumped on every change, see ir_dirty
 } ir_program_t;
 
 ir_program_t *get_ir_program();
@@ -104,13 +186,32 @@ iropr_var_t *gen_temp_var(type_t *type);
 ir_label_t *gen_label();
 void ir_hole(void (*hole_func)(ir_t **), int n);
 void build_cfg(ir_cfg_t *cfg);
+void ir_edge_add(ir_cfg_t *cfg, ir_bb_t *from, ir_bb_t *to);
+void ir_edge_remove(ir_cfg_t *cfg, ir_bb_t *from, ir_bb_t *to);
 void build_program();
+void ir_rebuild_cfg(ir_cfg_t *cfg, LIST(ir_t*) *irs);
 void check_program_reachable();
+void ir_code_build(ir_cfg_t *cfg);
+void ir_du_build(ir_cfg_t *cfg);
+void ir_dom_build(ir_cfg_t *cfg);
+int ir_dominates(ir_dom_t *dom, int a, int b);
+void ir_alias_build(ir_cfg_t *cfg);
+alias_t ir_alias(ir_cfg_t *cfg, int p, int q);
+alias_t ir_alias_span(ir_cfg_t *cfg, int p, int size, int q);
+int ir_alias_call(ir_cfg_t *cfg, int p);
+void ir_remove(ir_cfg_t *cfg, int i);
+void ir_replace(ir_cfg_t *cfg, int i, ir_t *ir);
+void ir_touch(ir_cfg_t *cfg, int i);
+ir_bb_t *ir_bb_of(ir_cfg_t *cfg, int i);
+void ir_dirty(ir_cfg_t *cfg, int i);
+int oprc_imm(ir_code_t *code, iropr_code_t opr);
 void ir_analyse_cfg(ir_cfg_t *cfg, void (*ana_func)(ir_cfg_t *, ir_bb_t *));
 void ir_iter_cfg(ir_cfg_t *cfg, void *res, worklist_t *wl, 
   void *meet, // void meet(ir_res_t *res, ir_bb_t *dst, ir_bb_t *src);
   void *skip, // int skip(ir_res_t *res, ir_bb_t *bb); NULL = no skip
   void *trans, // int trans(ir_res_t *res, LIST(ir_t *) *irs, ir_bb_t *bb);
-  int forward);
+  void *reset, // void reset(ir_res_t *res, ir_bb_t *bb); back to the initial facts
+  int forward,
+  int since); // program stamp of the kept solution, 0 = solve from scratch
 
 #endif
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "ir.h"
+
+// Points-to facts are solved over the whole cfg at once, ignoring order:
+// a var points to obj + off if every def that yields an address agrees.
+// Values that come from memory, calls, reads or params are untracked
+// pointers unless the var is a plain int / float.
+
+#define PT_UNKNOWN (-3) // contributed by an untracked def, same as PT_ANY
+
+typedef struct ir_alias_ctx {
+  ir_alias_t *a;
+  int changed;
+} ir_alias_ctx_t;
+
+static void escape(ir_alias_t *a, int obj) {
+  if (obj >= 0) a->escaped[obj] = 1;
+}
+
+// var may now also hold obj + off
+static void join(ir_alias_ctx_t *c, int var, int obj, int off) {
+  ir_alias_t *a = c->a;
+  int cur = a->obj[var];
+  if (obj == PT_NONE) return;
+  if (obj == PT_UNKNOWN) obj = PT_ANY;
+  if (cur == PT_ANY) {
+    escape(a, obj);
+    return;
+  }
+  if (cur == PT_NONE) {
+    a->obj[var] = obj;
+    a->off[var] = off;
+  } else if (obj == PT_ANY || obj != cur) {
+    escape(a, cur);
+    escape(a, obj);
+    a->obj[var] = PT_ANY;
+  } else if (a->off[var] != off && a->off[var] != OFF_ANY) {
+    a->off[var] = OFF_ANY;
+  } else {
+    return;
+  }
+  c->changed = 1;
+}
+
+static int opr_obj(ir_alias_t *a, iropr_t *opr) {
+  return opr->oprid == E_iropr_var ? a->obj[((iropr_var_t *)opr)->id] : PT_NONE;
+}
+
+// the address in opr leaves the tracked vars
+static void leak(ir_alias_t *a, iropr_t *opr) {
+  int obj = opr_obj(a, opr);
+  escape(a, obj);
+}
+
+static void untracked(ir_alias_ctx_t *c, iropr_var_t *var) {
+  typeid_t t = var->type->typeid;
+  if (t != E_type_int && t != E_type_float) join(c, var->id, PT_UNKNOWN, 0);
+}
+
+static void ir_alias_arth(ir_alias_ctx_t *c, ir_arth_t *arth) {
+  ir_alias_t *a = c->a;
+  int o1 = opr_obj(a, arth->opr1), o2 = opr_obj(a, arth->opr2);
+  if (o1 == PT_NONE && o2 == PT_NONE) return;
+  int lhs = arth->lhs->id;
+  if ((o1 != PT_NONE && o2 != PT_NONE) || arth->op == OP2_STAR ||
+      arth->op == OP2_DIV || (arth->op == OP2_MINUS && o2 != PT_NONE)) {
+    leak(a, arth->opr1);
+    leak(a, arth->opr2);
+    join(c, lhs, PT_ANY, 0);
+    return;
+  }
+  iropr_t *base = o1 != PT_NONE ? arth->opr1 : arth->opr2;
+  iropr_t *idx = o1 != PT_NONE ? arth->opr2 : arth->opr1;
+  int obj = o1 != PT_NONE ? o1 : o2, off = a->off[((iropr_var_t *)base)->id];
+  if (obj < 0 || off == OFF_ANY || idx->oprid != E_iropr_imm) {
+    join(c, lhs, obj, OFF_ANY);
+  } else {
+    int k = ((iropr_imm_t *)idx)->val;
+    join(c, lhs, obj, arth->op == OP2_PLUS ? off + k : off - k);
+  }
+}
+
+static void ir_alias_ir(ir_alias_ctx_t *c, ir_t *ir) {
+  ir_alias_t *a = c->a;
+  switch (ir->irid) {
+  case E_ir_func:
+    for (iropr_vars_t *l = ((ir_func_t *)ir)->params; l; l = l->next) {
+      untracked(c, l->opr);
+    }
+    break;
+  case E_ir_addr: {
+    ir_addr_t *addr = (ir_addr_t *)ir;
+    join(c, addr->lhs->id, addr->rhs->id, 0);
+    break;
+  }
+  case E_ir_mov: {
+    ir_mov_t *mov = (ir_mov_t *)ir;
+    if (mov->rhs->oprid == E_iropr_var) {
+      int r = ((iropr_var_t *)mov->rhs)->id;
+      join(c, mov->lhs->id, a->obj[r], a->off[r]);
+    }
+    break;
+  }
+  case E_ir_arth: ir_alias_arth(c, (ir_arth_t *)ir); break;
+  case E_ir_load: untracked(c, ((ir_load_t *)ir)->lhs); break;
+  case E_ir_read: untracked(c, ((ir_read_t *)ir)->opr); break;
+  case E_ir_call: {
+    ir_call_t *call = (ir_call_t *)ir;
+    for (iroprs_t *l = call->args; l; l = l->next) leak(a, l->opr);
+    untracked(c, call->ret);
+    break;
+  }
+  case E_ir_store: leak(a, ((ir_store_t *)ir)->rhs); break;
+  case E_ir_ret: leak(a, ((ir_ret_t *)ir)->opr); break;
+  case E_ir_write: leak(a, ((ir_write_t *)ir)->opr); break;
+  default: ;
+  }
+}
+
+void ir_alias_build(ir_cfg_t *cfg) {
+  LIST(ir_t*) *irs = cfg->irs;
+  ir_alias_t *a = &cfg->alias;
+  int n = get_ir_program()->var_num;
+  if (a->cap < n) {
+    a->cap = n;
+    a->obj = realloc(a->obj, n * sizeof(int));
+    a->off = realloc(a->off, n * sizeof(int));
+    a->escaped = realloc(a->escaped, n);
+  }
+  for (int v = 0; v < n; ++v) a->obj[v] = PT_NONE;
+  memset(a->escaped, 0, n);
+  ir_alias_ctx_t c = {a, 1};
+  while (c.changed) {
+    c.changed = 0;
+    for (int i = 0; i < irs->size; ++i) {
+      ir_alias_ir(&c, irs->array[i]);
+    }
+  }
+}
+
+static alias_t overlap(ir_alias_t *a, int p, int psize, int q, int qsize) {
+  int op = a->obj[p], oq = a->obj[q];
+  if (op < 0 && oq < 0) return E_alias_may;
+  if (op < 0) return a->escaped[oq] ? E_alias_may : E_alias_no;
+  if (oq < 0) return a->escaped[op] ? E_alias_may : E_alias_no;
+  if (op != oq) return E_alias_no;
+  if (a->off[p] == OFF_ANY || a->off[q] == OFF_ANY) return E_alias_may;
+  int d = a->off[p] - a->off[q];
+  if (d == 0 && psize == qsize) return E_alias_must;
+  return d >= qsize || -d >= psize ? E_alias_no : E_alias_may;
+}
+
+// may the words at the addresses in vars p and q overlap
+alias_t ir_alias(ir_cfg_t *cfg, int p, int q) {
+  return overlap(&cfg->alias, p, 4, q, 4);
+}
+
+// may the size bytes at the address in var p overlap the word at q
+alias_t ir_alias_span(ir_cfg_t *cfg, int p, int size, int q) {
+  return overlap(&cfg->alias, p, size, q, 4);
+}
+
+// may a call read or write the word at the address in var p
+int ir_alias_call(ir_cfg_t *cfg, int p) {
+  ir_alias_t *a = &cfg->alias;
+  return a->obj[p] < 0 || a->escaped[a->obj[p]];
+}
@@ -7,35 +7,74 @@ typedef struct ir_df_bs {
   bitset_t *in, *out;
 } ir_df_bs_t;
 
+struct ir_code;
+
 typedef struct ir_livevar_res {
   ir_df_bs_t *res;
+  struct ir_code *code;
   bitset_t *cross_call;
   worklist_t *worklist;
   bitset_t *buf;
+  int stamp; // program stamp of the solution in res
 } ir_livevar_res_t;
 
 typedef struct ir_df_map {
   hashmap_t *in, *out;
 } ir_df_map_t;
 
+struct iropr_var;
+
+typedef struct ir_avfact {
+  struct iropr_var *holder;
+  int expr, next; // next fact of the same expression, -1 = none
+} ir_avfact_t;
+
 typedef struct ir_avexpr_res {
-  ir_df_map_t *res;
+  ir_df_bs_t *res; // indexed by bb->no
+  int *in_top, *out_top;
+  int bb_num, id_num;
+  HMAP(ir_arth_t *, int) *expr_no; // expression -> no + 1
+  int *expr_head, expr_num, expr_cap;
+  ir_avfact_t *facts;
+  int fact_num, fact_cap;
+  int *var_no, *vars, var_num; // global var id <-> local var no
+  bitset_t **kill; // indexed by local var no
+  int kill_num;
   worklist_t *worklist;
-  HMAP(ir_arth_t *, iropr_var_t *) *buf;
+  bitset_t *buf, *next;
+  int stamp;
 } ir_avexpr_res_t;
 
 typedef void *ir_cval_t;
 
+typedef struct ir_cvec {
+  ir_cval_t *val;  // indexed by local var no, UNDEF = NULL
+  int *dirty;      // local var nos that may hold a non-UNDEF value
+  int dirty_num;
+  bitset_t *listed;
+} ir_cvec_t;
+
+typedef struct ir_df_cvec {
+  ir_cvec_t *in, *out;
+} ir_df_cvec_t;
+
 typedef struct ir_constant_res {
-  ir_df_map_t *res;
+  ir_df_cvec_t *res; // indexed by bb->no
+  struct ir_code *code;
+  int bb_num, var_num, var_cap, id_num;
+  int *var_no, *vars; // global var id <-> local var no, -1 = never defined
   worklist_t *worklist;
-  HMAP(iropr_var_t *, ir_cval_t) *buf;
+  ir_cvec_t *buf;
+  int *pend_no, pend_num;
+  ir_cval_t *pend_val;
+  int stamp;
 } ir_constant_res_t;
 
 typedef struct ir_arthprog_res {
   ir_df_map_t *res;
   worklist_t *worklist;
   HMAP(iropr_var_t *, ir_cval_t) *buf;
+  int stamp;
 } ir_arthprog_res_t;
 
 #define BB_OUT(r, bb) ((r)->res[(bb)->range.end - 1].out)
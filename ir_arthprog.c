@@ -81,68 +81,50 @@ static int decode_vv(ir_cval_t cv, int *var1, int *var2, op2_t *op) {
   return 1;
 }
 
-static int inited = 0, do_opt = 0, final = 0;
-
-static void ir_arthprog_reinit(ir_program_t *program) {
-  assert(inited);
-  LIST(ir_cfg_t*) *cfgs = program->cfgs;
-  for (int i = 0; i < cfgs->size; ++i) {
-    ir_cfg_t *cfg = cfgs->array[i];
-    if (!cfg->reachable) continue;
-    LIST(ir_bb_t*) *bbs = cfg->bbs;
-    ir_arthprog_res_t *res = &(cfg->arthprog_res);
-    assert(worklist_empty(res->worklist));
-    for (int j = 0; j < bbs->size; ++j) {
-      ir_bb_t *bb = bbs->array[j];
-      if (!bb->reachable) continue;
-      int st = bb->range.start, ed = bb->range.end - 1;
-      hmap_removeall(res->res[st].in);
-      res->res[st].in->is_top = 1;
-      for (int k = st; k <= ed; ++k) {
-        hmap_removeall(res->res[k].out);
-        res->res[k].out->is_top = 1;
-        if (k != ed) assert(res->res[k + 1].in == res->res[k].out);
-      }
-    }
-    assert(bbs->size > 0);
-    ir_bb_t *startbb = bbs->array[0];
-    BB_IN(res, startbb)->is_top = 0;
-  }
-}
+static int do_opt = 0, final = 0;
 
 static void ir_arthprog_init(ir_program_t *program, int fi) {
   do_opt = 0;
   final = fi;
   assert(sizeof(void *) == 8);
   assert(sizeof(val_union_t) == 8);
-  if (inited) {
-    ir_arthprog_reinit(program);
-    return;
-  } else {
-    inited = 1;
-  }
   LIST(ir_cfg_t*) *cfgs = program->cfgs;
   for (int i = 0; i < cfgs->size; ++i) {
     ir_cfg_t *cfg = cfgs->array[i];
     if (!cfg->reachable) continue;
     LIST(ir_bb_t*) *bbs = cfg->bbs;
     ir_arthprog_res_t *res = &(cfg->arthprog_res);
+    if (res->res) continue;
     res->res = calloc(cfg->irs->size + 1, sizeof(ir_df_map_t));
     res->worklist = new_worklist(bbs->size);
-    res->buf = new_hmap(same_iropr, NULL, hash_iropr, 0);
+    if (res->buf == NULL) {
+      res->buf = new_hmap(same_iropr, NULL, hash_iropr, NULL, 0);
+    }
+    res->stamp = 0;
     for (int j = 0; j < bbs->size; ++j) {
       ir_bb_t *bb = bbs->array[j];
       if (!bb->reachable) continue;
       int st = bb->range.start, ed = bb->range.end - 1;
-      res->res[st].in = new_hmap(same_iropr, NULL, hash_iropr, 1);
+      res->res[st].in = new_hmap(same_iropr, NULL, hash_iropr, NULL, 1);
       for (int k = st; k <= ed; ++k) {
-        res->res[k].out = new_hmap(same_iropr, NULL, hash_iropr, 1);
+        res->res[k].out = new_hmap(same_iropr, NULL, hash_iropr, NULL, 1);
         if (k != ed) res->res[k + 1].in = res->res[k].out;
       }
     }
-    assert(bbs->size > 0);
-    ir_bb_t *startbb = bbs->array[0];
-    BB_IN(res, startbb)->is_top = 0;
+  }
+}
+
+static void reset_map(hashmap_t *map, int top) {
+  map->is_top = 0;
+  hmap_removeall(map);
+  map->is_top = top;
+}
+
+static void ir_arthprog_reset(ir_arthprog_res_t *res, ir_bb_t *bb) {
+  int st = bb->range.start, ed = bb->range.end - 1;
+  reset_map(res->res[st].in, bb->no != 0);
+  for (int k = st; k <= ed; ++k) {
+    reset_map(res->res[k].out, 1);
   }
 }
 
@@ -278,6 +260,12 @@ DEF_VISIT_FUNC(ir_arthprog, ir_arth) {
   return NULL;
 }
 
+DEF_VISIT_FUNC(ir_arthprog, ir_set) {
+  ir_arthprog_kill_l(v->res, v->index, n->lhs);
+  ir_arthprog_kill(v->res, v->index, n->lhs);
+  return NULL;
+}
+
 DEF_VISIT_FUNC(ir_arthprog, ir_addr) {
   ir_arthprog_kill_l(v->res, v->index, n->lhs);
   ir_arthprog_kill(v->res, v->index, n->lhs);
@@ -294,6 +282,10 @@ DEF_VISIT_FUNC(ir_arthprog, ir_store) {
   return NULL;
 }
 
+DEF_VISIT_FUNC(ir_arthprog, ir_memcpy) {
+  return NULL;
+}
+
 DEF_VISIT_FUNC(ir_arthprog, ir_goto) {
   return NULL;
 }
@@ -558,16 +550,23 @@ static iropr_t *cval2opr(ir_cval_t cv) {
   }
 }
 
-static iropr_t *try_fold(HMAP(iropr_var_t *, ir_cval_t) *map, 
-  iropr_t *opr, int lhsid) {
+typedef struct ir_arthsimp {
+  void **table;
+  HMAP(iropr_var_t *, iropr_var_t *) *in_map, *out_map;
+  ir_cfg_t *cfg;
+  int index;
+} ir_arthsimp_t;
+
+static iropr_t *try_fold(ir_arthsimp_t *v, iropr_t *opr, int lhsid) {
   if (opr->oprid == E_iropr_imm) {
     return opr;
   } else {
     assert(opr->oprid == E_iropr_var);
     iropr_var_t *o = (iropr_var_t *)opr;
-    iropr_t *res = cval2opr(fold_to(map, make_ivi(o->id, 1, 0), 0, lhsid));
+    iropr_t *res = cval2opr(fold_to(v->in_map, make_ivi(o->id, 1, 0), 0, lhsid));
     if (res && !same_iropr(opr, res)) {
       do_opt = 1;
+      ir_touch(v->cfg, v->index);
       return res;
     }
     return opr;
@@ -611,12 +610,6 @@ static ir_t *cval2ir(ir_cval_t cv, iropr_var_t *lhs) {
   }
 }
 
-typedef struct ir_arthsimp {
-  void **table;
-  HMAP(iropr_var_t *, iropr_var_t *) *in_map, *out_map;
-  ir_t **ir_pos;
-} ir_arthsimp_t;
-
 DEF_VISIT_FUNC(ir_arthsimp, ir_nop) {
   return NULL;
 }
@@ -635,14 +628,14 @@ DEF_VISIT_FUNC(ir_arthsimp, ir_mov) {
     ir_t *ir = cval2ir(cv, n->lhs);
     if (ir->irid != E_ir_mov || !same_iropr(((ir_mov_t *)ir)->rhs, n->rhs)) {
       do_opt = 1;
-      v->ir_pos[0] = ir;
+      ir_replace(v->cfg, v->index, ir);
       return NULL;
     }
   }
-  n->rhs = try_fold(v->in_map, n->rhs, -1);
+  n->rhs = try_fold(v, n->rhs, -1);
   if (same_iropr((iropr_t *)(n->lhs), n->rhs)) {
     do_opt = 1;
-    n->irid = E_ir_nop;
+    ir_remove(v->cfg, v->index);
   }
   return NULL;
 }
@@ -653,12 +646,18 @@ DEF_VISIT_FUNC(ir_arthsimp, ir_arth) {
     ir_t *ir = cval2ir(cv, n->lhs);
     if (ir->irid != E_ir_arth || !same_ir_arth((ir_arth_t *)ir, n)) {
       do_opt = 1;
-      v->ir_pos[0] = ir;
+      ir_replace(v->cfg, v->index, ir);
       return NULL;
     }
   }
-  n->opr1 = try_fold(v->in_map, n->opr1, final ? -1 : n->lhs->id);
-  n->opr2 = try_fold(v->in_map, n->opr2, final ? -1 : n->lhs->id);
+  n->opr1 = try_fold(v, n->opr1, final ? -1 : n->lhs->id);
+  n->opr2 = try_fold(v, n->opr2, final ? -1 : n->lhs->id);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_arthsimp, ir_set) {
+  n->opr1 = try_fold(v, n->opr1, final ? -1 : n->lhs->id);
+  n->opr2 = try_fold(v, n->opr2, final ? -1 : n->lhs->id);
   return NULL;
 }
 
@@ -667,15 +666,23 @@ DEF_VISIT_FUNC(ir_arthsimp, ir_addr) {
 }
 
 DEF_VISIT_FUNC(ir_arthsimp, ir_load) {
-  n->rhs = (iropr_var_t *)try_fold(v->in_map, (iropr_t *)n->rhs, -1);
+  n->rhs = (iropr_var_t *)try_fold(v, (iropr_t *)n->rhs, -1);
   assert(n->rhs->oprid == E_iropr_var);
   return NULL;
 }
 
 DEF_VISIT_FUNC(ir_arthsimp, ir_store) {
-  n->lhs = (iropr_var_t *)try_fold(v->in_map, (iropr_t *)n->lhs, -1);
+  n->lhs = (iropr_var_t *)try_fold(v, (iropr_t *)n->lhs, -1);
   assert(n->lhs->oprid == E_iropr_var);
-  n->rhs = try_fold(v->in_map, n->rhs, -1);
+  n->rhs = try_fold(v, n->rhs, -1);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_arthsimp, ir_memcpy) {
+  n->lhs = (iropr_var_t *)try_fold(v, (iropr_t *)n->lhs, -1);
+  assert(n->lhs->oprid == E_iropr_var);
+  n->rhs = (iropr_var_t *)try_fold(v, (iropr_t *)n->rhs, -1);
+  assert(n->rhs->oprid == E_iropr_var);
   return NULL;
 }
 
@@ -684,8 +691,8 @@ DEF_VISIT_FUNC(ir_arthsimp, ir_goto) {
 }
 
 DEF_VISIT_FUNC(ir_arthsimp, ir_branch) {
-  n->opr1 = try_fold(v->in_map, n->opr1, -1);
-  n->opr2 = try_fold(v->in_map, n->opr2, -1);
+  n->opr1 = try_fold(v, n->opr1, -1);
+  n->opr2 = try_fold(v, n->opr2, -1);
   if (n->opr1->oprid == E_iropr_var && n->opr2->oprid == E_iropr_var) {
     iropr_var_t *v1 = (iropr_var_t *)(n->opr1), *v2 = (iropr_var_t *)(n->opr2);
     iropr_t *opr = 
@@ -694,13 +701,14 @@ DEF_VISIT_FUNC(ir_arthsimp, ir_branch) {
       n->opr1 = opr;
       n->opr2 = (iropr_t *)&IMM0;
       do_opt = 1;
+      ir_touch(v->cfg, v->index);
     }
   }
   return NULL;
 }
 
 DEF_VISIT_FUNC(ir_arthsimp, ir_ret) {
-  n->opr = try_fold(v->in_map, n->opr, -1);
+  n->opr = try_fold(v, n->opr, -1);
   return NULL;
 }
 
@@ -710,7 +718,7 @@ DEF_VISIT_FUNC(ir_arthsimp, ir_alloc) {
 
 DEF_VISIT_FUNC(ir_arthsimp, ir_call) {
   for (iroprs_t *l = n->args; l; l = l->next) {
-    l->opr = try_fold(v->in_map, l->opr, -1);
+    l->opr = try_fold(v, l->opr, -1);
   }
   return NULL;
 }
@@ -720,7 +728,7 @@ DEF_VISIT_FUNC(ir_arthsimp, ir_read) {
 }
 
 DEF_VISIT_FUNC(ir_arthsimp, ir_write) {
-  n->opr = try_fold(v->in_map, n->opr, -1);
+  n->opr = try_fold(v, n->opr, -1);
   return NULL;
 }
 
@@ -731,14 +739,14 @@ static ir_visitor_table_t ir_arthsimp_table = {
 };
 
 static void ir_arthsimp_bb(ir_cfg_t *cfg, ir_bb_t *bb) {
-  ir_arthsimp_t visitor = {ir_arthsimp_table, NULL, NULL};
+  ir_arthsimp_t visitor = {ir_arthsimp_table, NULL, NULL, cfg, 0};
   ir_arthprog_res_t *res = &cfg->arthprog_res;
   LIST(ir_t*) *irs = cfg->irs;
   int st = bb->range.start, ed = bb->range.end - 1;
   for (int i = st; i <= ed; ++i) {
     visitor.in_map = res->res[i].in;
     visitor.out_map = res->res[i].out;
-    visitor.ir_pos = (ir_t **)&(irs->array[i]);
+    visitor.index = i;
     ir_visit(&visitor, irs->array[i]);
   }
 }
@@ -750,10 +758,11 @@ int ir_arthprog(int final) {
   for (int i = 0; i < cfgs->size; ++i) {
     ir_cfg_t *cfg = cfgs->array[i];
     if (!cfg->reachable) continue;
-    ir_iter_cfg(cfg, &cfg->arthprog_res, cfg->arthprog_res.worklist,
-      ir_arthprog_meet, ir_arthprog_skip, ir_arthprog_transfer_bb, 1);
+    ir_arthprog_res_t *res = &cfg->arthprog_res;
+    ir_iter_cfg(cfg, res, res->worklist, ir_arthprog_meet, ir_arthprog_skip, 
+      ir_arthprog_transfer_bb, ir_arthprog_reset, 1, res->stamp);
+    res->stamp = program->stamp;
     ir_analyse_cfg(cfg, ir_arthsimp_bb);
-    build_cfg(cfg);
   }
   return do_opt;
 }
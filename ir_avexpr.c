@@ -5,139 +5,242 @@
 #include "ir_visitor.h"
 #include "ir.h"
 
-static int inited = 0, do_opt = 0;
+static int do_opt = 0;
 
-static void ir_avexpr_reinit(ir_program_t *program) {
-  assert(inited);
-  LIST(ir_cfg_t*) *cfgs = program->cfgs;
-  for (int i = 0; i < cfgs->size; ++i) {
-    ir_cfg_t *cfg = cfgs->array[i];
-    if (!cfg->reachable) continue;
-    LIST(ir_bb_t*) *bbs = cfg->bbs;
-    ir_avexpr_res_t *res = &(cfg->avexpr_res);
-    assert(worklist_empty(res->worklist));
+#define FACT_NIL (-1)
+
+static void ir_avexpr_grow(ir_avexpr_res_t *res) {
+  res->fact_cap *= 2;
+  res->facts = realloc(res->facts, res->fact_cap * sizeof(ir_avfact_t));
+  for (int i = 0; i < res->bb_num; ++i) {
+    bitset_resize(res->res[i].in, res->fact_cap);
+    bitset_resize(res->res[i].out, res->fact_cap);
+  }
+  for (int i = 0; i < res->kill_num; ++i) {
+    bitset_resize(res->kill[i], res->fact_cap);
+  }
+  bitset_resize(res->buf, res->fact_cap);
+  bitset_resize(res->next, res->fact_cap);
+}
+
+static int lookup_expr(ir_avexpr_res_t *res, ir_arth_t *expr) {
+  return (int)(uint64_t)hmap_get(res->expr_no, expr) - 1;
+}
+
+static int number_expr(ir_avexpr_res_t *res, ir_arth_t *expr) {
+  int no = lookup_expr(res, expr);
+  if (no >= 0) return no;
+  if (res->expr_num == res->expr_cap) {
+    res->expr_cap *= 2;
+    res->expr_head = realloc(res->expr_head, res->expr_cap * sizeof(int));
+  }
+  no = res->expr_num++;
+  res->expr_head[no] = FACT_NIL;
+  hmap_put(res->expr_no, IRNEW(ir_arth, NULL, expr->opr1, expr->opr2, expr->op), 
+    (void *)(uint64_t)(no + 1));
+  return no;
+}
+
+static int number_var(ir_avexpr_res_t *res, iropr_var_t *var) {
+  if (res->var_no[var->id] < 0) {
+    res->var_no[var->id] = res->var_num;
+    res->vars[res->var_num] = var->id;
+    if (res->var_num < res->kill_num) {
+      bitset_resize(res->kill[res->var_num], res->fact_cap);
+      bitset_zero(res->kill[res->var_num]);
+    } else {
+      res->kill[res->kill_num++] = new_bitset(res->fact_cap, 0);
+    }
+    res->var_num++;
+  }
+  return res->var_no[var->id];
+}
+
+static void add_kill(ir_avexpr_res_t *res, iropr_t *opr, int fact) {
+  if (opr->oprid == E_iropr_var) {
+    bitset_set(res->kill[number_var(res, (iropr_var_t *)opr)], fact);
+  }
+}
+
+static int number_fact(ir_avexpr_res_t *res, ir_arth_t *expr, iropr_var_t *holder) {
+  int e = number_expr(res, expr);
+  for (int f = res->expr_head[e]; f != FACT_NIL; f = res->facts[f].next) {
+    if (res->facts[f].holder->id == holder->id) return f;
+  }
+  if (res->fact_num == res->fact_cap) {
+    ir_avexpr_grow(res);
+  }
+  int f = res->fact_num++;
+  res->facts[f] = (ir_avfact_t){holder, e, res->expr_head[e]};
+  res->expr_head[e] = f;
+  add_kill(res, expr->opr1, f);
+  add_kill(res, expr->opr2, f);
+  add_kill(res, (iropr_t *)holder, f);
+  return f;
+}
+
+static void ir_avexpr_number(ir_cfg_t *cfg) {
+  ir_avexpr_res_t *res = &(cfg->avexpr_res);
+  LIST(ir_t*) *irs = cfg->irs;
+  for (int i = 0; i < irs->size; ++i) {
+    ir_t *ir = irs->array[i];
+    if (ir->irid == E_ir_arth) {
+      ir_arth_t *arth = (ir_arth_t *)ir;
+      number_fact(res, arth, arth->lhs);
+    } else if (ir->irid == E_ir_mov) {
+      ir_mov_t *mov = (ir_mov_t *)ir;
+      ir_arth_t arth = {E_ir_arth, 0, mov->rhs, (iropr_t *)&IMM0, OP2_PLUS};
+      number_fact(res, &arth, mov->lhs);
+    }
+  }
+}
+
+static void ir_avexpr_init_cfg(ir_cfg_t *cfg, int vars) {
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  ir_avexpr_res_t *res = &(cfg->avexpr_res);
+  if (res->expr_no == NULL) {
+    res->expr_no = new_hmap(same_ir_arth, NULL, hash_ir_arth, NULL, 0);
+    res->expr_cap = 64;
+    res->expr_head = malloc(res->expr_cap * sizeof(int));
+    res->fact_cap = 64;
+    res->facts = malloc(res->fact_cap * sizeof(ir_avfact_t));
+    res->buf = new_bitset(res->fact_cap, 0);
+    res->next = new_bitset(res->fact_cap, 0);
+  }
+  // facts are only ever added, so a kept solution stays meaningful
+  if (res->id_num < vars) {
+    res->var_no = realloc(res->var_no, vars * sizeof(int));
+    memset(res->var_no + res->id_num, 0xff, (vars - res->id_num) * sizeof(int));
+    res->vars = realloc(res->vars, vars * sizeof(int));
+    res->kill = realloc(res->kill, vars * sizeof(bitset_t *));
+    res->id_num = vars;
+  }
+  if (bbs->size != res->bb_num) {
+    res->bb_num = bbs->size;
+    res->res = realloc(res->res, bbs->size * sizeof(ir_df_bs_t));
+    res->in_top = realloc(res->in_top, bbs->size * sizeof(int));
+    res->out_top = realloc(res->out_top, bbs->size * sizeof(int));
     for (int j = 0; j < bbs->size; ++j) {
-      ir_bb_t *bb = bbs->array[j];
-      if (!bb->reachable) continue;
-      int st = bb->range.start, ed = bb->range.end - 1;
-      hmap_removeall(res->res[st].in);
-      res->res[st].in->is_top = 1;
-      for (int k = st; k <= ed; ++k) {
-        hmap_removeall(res->res[k].out);
-        res->res[k].out->is_top = 1;
-        if (k != ed) assert(res->res[k + 1].in == res->res[k].out);
-      }
+      res->res[j].in = new_bitset(res->fact_cap, 0);
+      res->res[j].out = new_bitset(res->fact_cap, 0);
     }
-    assert(bbs->size > 0);
-    ir_bb_t *startbb = bbs->array[0];
-    BB_IN(res, startbb)->is_top = 0;
+    free(res->worklist);
+    res->worklist = new_worklist(bbs->size);
+    res->stamp = 0;
   }
+  assert(worklist_empty(res->worklist));
+  ir_avexpr_number(cfg);
+}
+
+static void ir_avexpr_reset(ir_avexpr_res_t *res, ir_bb_t *bb) {
+  bitset_zero(res->res[bb->no].in);
+  bitset_zero(res->res[bb->no].out);
+  res->in_top[bb->no] = bb->no != 0;
+  res->out_top[bb->no] = 1;
 }
 
 static void ir_avexpr_init(ir_program_t *program) {
   do_opt = 0;
-  if (inited) {
-    ir_avexpr_reinit(program);
-    return;
-  } else {
-    inited = 1;
-  }
   LIST(ir_cfg_t*) *cfgs = program->cfgs;
   for (int i = 0; i < cfgs->size; ++i) {
     ir_cfg_t *cfg = cfgs->array[i];
     if (!cfg->reachable) continue;
-    LIST(ir_bb_t*) *bbs = cfg->bbs;
-    ir_avexpr_res_t *res = &(cfg->avexpr_res);
-    res->res = calloc(cfg->irs->size + 1, sizeof(ir_df_map_t));
-    res->worklist = new_worklist(bbs->size);
-    res->buf = new_hmap(same_ir_arth, same_iropr, hash_ir_arth, 0);
-    for (int j = 0; j < bbs->size; ++j) {
-      ir_bb_t *bb = bbs->array[j];
-      if (!bb->reachable) continue;
-      int st = bb->range.start, ed = bb->range.end - 1;
-      res->res[st].in = new_hmap(same_ir_arth, same_iropr, hash_ir_arth, 1);
-      for (int k = st; k <= ed; ++k) {
-        res->res[k].out = new_hmap(same_ir_arth, same_iropr, hash_ir_arth, 1);
-        if (k != ed) res->res[k + 1].in = res->res[k].out;
-      }
-    }
-    assert(bbs->size > 0);
-    ir_bb_t *startbb = bbs->array[0];
-    BB_IN(res, startbb)->is_top = 0;
+    ir_avexpr_init_cfg(cfg, program->var_num);
+  }
+}
+
+#define ABB_IN(r, bb)  ((r)->res[(bb)->no].in)
+#define ABB_OUT(r, bb) ((r)->res[(bb)->no].out)
+
+static iropr_var_t *avexpr_get(ir_avexpr_res_t *res, bitset_t *bs, ir_arth_t *expr) {
+  int e = lookup_expr(res, expr);
+  if (e < 0) return NULL;
+  for (int f = res->expr_head[e]; f != FACT_NIL; f = res->facts[f].next) {
+    if (bitset_test(bs, f)) return res->facts[f].holder;
   }
+  return NULL;
 }
 
-static void ir_avexpr_copy(ir_avexpr_res_t *res, int index) {
-  hmap_copy(res->res[index].out, res->res[index].in);
+static void avexpr_put(ir_avexpr_res_t *res, bitset_t *bs, 
+    ir_arth_t *expr, iropr_var_t *holder) {
+  int fact = number_fact(res, expr, holder);
+  for (int f = res->expr_head[res->facts[fact].expr]; f != FACT_NIL; 
+      f = res->facts[f].next) {
+    bitset_clear(bs, f);
+  }
+  bitset_set(bs, fact);
 }
 
-static void ir_avexpr_gen_mov(ir_avexpr_res_t *res, int index, ir_mov_t *gen) {
+static void ir_avexpr_gen_mov(ir_avexpr_res_t *res, bitset_t *in, bitset_t *out, 
+    ir_mov_t *gen) {
+  ir_arth_t arth = {E_ir_arth, 0, gen->rhs, (iropr_t *)&IMM0, OP2_PLUS};
   if (!same_iropr((iropr_t *)gen->lhs, gen->rhs)) {
-    hmap_put(res->res[index].out, IRNEW(ir_arth, gen->lhs, gen->rhs, 
-      (iropr_t *)&IMM0, OP2_PLUS), gen->lhs);
+    avexpr_put(res, out, &arth, gen->lhs);
   }
-  ir_arth_t arth = {E_ir_arth, 0, gen->rhs, (iropr_t *)&IMM0, OP2_PLUS};
   iropr_var_t *nrhs;
-  while ((nrhs = hmap_get(res->res[index].in, &arth))) {
+  while ((nrhs = avexpr_get(res, in, &arth))) {
     arth.opr1 = (iropr_t *)nrhs;
     if (!same_iropr((iropr_t *)gen->lhs, (iropr_t *)nrhs)) {
-      hmap_put(res->res[index].out, IRNEW(ir_arth, gen->lhs, (iropr_t *)nrhs, 
-        (iropr_t *)&IMM0, OP2_PLUS), gen->lhs);
+      avexpr_put(res, out, &arth, gen->lhs);
     }
   }
 }
 
-static void ir_avexpr_arth_opr2(ir_avexpr_res_t *res, int index, ir_arth_t *gen) {
+static void ir_avexpr_arth_opr2(ir_avexpr_res_t *res, bitset_t *in, bitset_t *out, 
+    ir_arth_t *gen) {
   if (!same_iropr((iropr_t *)gen->lhs, gen->opr2)) {
-    hmap_put(res->res[index].out, gen, gen->lhs);
+    avexpr_put(res, out, gen, gen->lhs);
   }
   ir_arth_t arth = {E_ir_arth, 0, gen->opr2, (iropr_t *)&IMM0, OP2_PLUS};
+  ir_arth_t narth = *gen;
   iropr_var_t *nrhs;
-  while ((nrhs = hmap_get(res->res[index].in, &arth))) {
+  while ((nrhs = avexpr_get(res, in, &arth))) {
     arth.opr1 = (iropr_t *)nrhs;
     if (!same_iropr((iropr_t *)gen->lhs, (iropr_t *)nrhs)) {
-      hmap_put(res->res[index].out, IRNEW(ir_arth, gen->lhs, gen->opr1, 
-        (iropr_t *)nrhs, gen->op), gen->lhs);
+      narth.opr2 = (iropr_t *)nrhs;
+      avexpr_put(res, out, &narth, gen->lhs);
     }
   }
 }
 
-static void ir_avexpr_gen_arth(ir_avexpr_res_t *res, int index, ir_arth_t *gen) {
+static void ir_avexpr_gen_arth(ir_avexpr_res_t *res, bitset_t *in, bitset_t *out, 
+    ir_arth_t *gen) {
   if (!same_iropr((iropr_t *)gen->lhs, gen->opr1)) {
-    hmap_put(res->res[index].out, gen, gen->lhs);
+    avexpr_put(res, out, gen, gen->lhs);
   }
   ir_arth_t arth = {E_ir_arth, 0, gen->opr1, (iropr_t *)&IMM0, OP2_PLUS};
+  ir_arth_t narth = *gen;
   iropr_var_t *nrhs;
-  while ((nrhs = hmap_get(res->res[index].in, &arth))) {
+  while ((nrhs = avexpr_get(res, in, &arth))) {
     arth.opr1 = (iropr_t *)nrhs;
     if (!same_iropr((iropr_t *)gen->lhs, (iropr_t *)nrhs)) {
-      ir_avexpr_arth_opr2(res, index, IRNEW(ir_arth, gen->lhs, (iropr_t *)nrhs, 
-        gen->opr2, gen->op));
+      narth.opr1 = (iropr_t *)nrhs;
+      ir_avexpr_arth_opr2(res, in, out, &narth);
     }
   }
 }
 
-static iropr_var_t *kill_var;
-
-static int kill_condfunc(ir_arth_t *k, iropr_var_t *v) {
-  return same_iropr((iropr_t *)kill_var, k->opr1) 
-    || same_iropr((iropr_t *)kill_var, k->opr2)
-    || kill_var->id == v->id;
-}
-
-static void ir_avexpr_kill(ir_avexpr_res_t *res, int index, iropr_var_t *kill) {
-  kill_var = kill;
-  hmap_removeif(res->res[index].out, kill_condfunc);
+static void ir_avexpr_kill(ir_avexpr_res_t *res, bitset_t *out, iropr_var_t *kill) {
+  int no = res->var_no[kill->id];
+  if (no >= 0) {
+    bitset_andnot(out, res->kill[no]);
+  }
 }
 
 static void ir_avexpr_meet(ir_avexpr_res_t *res, ir_bb_t *dst, ir_bb_t *src) {
-  hmap_and(BB_IN(res, dst), BB_OUT(res, src));
+  if (res->out_top[src->no]) return;
+  if (res->in_top[dst->no]) {
+    res->in_top[dst->no] = 0;
+    bitset_copy(ABB_IN(res, dst), ABB_OUT(res, src));
+  } else {
+    bitset_and(ABB_IN(res, dst), ABB_OUT(res, src));
+  }
 }
 
 typedef struct ir_avexpr {
   void **table;
   ir_avexpr_res_t *res;
-  int index;
+  bitset_t *in, *out;
 } ir_avexpr_t;
 
 DEF_VISIT_FUNC(ir_avexpr, ir_nop) {
@@ -153,24 +256,29 @@ DEF_VISIT_FUNC(ir_avexpr, ir_func) {
 }
 
 DEF_VISIT_FUNC(ir_avexpr, ir_mov) {
-  ir_avexpr_kill(v->res, v->index, n->lhs);
-  ir_avexpr_gen_mov(v->res, v->index, n);
+  ir_avexpr_kill(v->res, v->out, n->lhs);
+  ir_avexpr_gen_mov(v->res, v->in, v->out, n);
   return NULL;
 }
 
 DEF_VISIT_FUNC(ir_avexpr, ir_arth) {
-  ir_avexpr_kill(v->res, v->index, n->lhs);
-  ir_avexpr_gen_arth(v->res, v->index, n);
+  ir_avexpr_kill(v->res, v->out, n->lhs);
+  ir_avexpr_gen_arth(v->res, v->in, v->out, n);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_avexpr, ir_set) {
+  ir_avexpr_kill(v->res, v->out, n->lhs);
   return NULL;
 }
 
 DEF_VISIT_FUNC(ir_avexpr, ir_addr) {
-  ir_avexpr_kill(v->res, v->index, n->lhs);
+  ir_avexpr_kill(v->res, v->out, n->lhs);
   return NULL;
 }
 
 DEF_VISIT_FUNC(ir_avexpr, ir_load) {
-  ir_avexpr_kill(v->res, v->index, n->lhs);
+  ir_avexpr_kill(v->res, v->out, n->lhs);
   return NULL;
 }
 
@@ -178,6 +286,10 @@ DEF_VISIT_FUNC(ir_avexpr, ir_store) {
   return NULL;
 }
 
+DEF_VISIT_FUNC(ir_avexpr, ir_memcpy) {
+  return NULL;
+}
+
 DEF_VISIT_FUNC(ir_avexpr, ir_goto) {
   return NULL;
 }
@@ -195,12 +307,12 @@ DEF_VISIT_FUNC(ir_avexpr, ir_alloc) {
 }
 
 DEF_VISIT_FUNC(ir_avexpr, ir_call) {
-  ir_avexpr_kill(v->res, v->index, n->ret);
+  ir_avexpr_kill(v->res, v->out, n->ret);
   return NULL;
 }
 
 DEF_VISIT_FUNC(ir_avexpr, ir_read) {
-  ir_avexpr_kill(v->res, v->index, n->opr);
+  ir_avexpr_kill(v->res, v->out, n->opr);
   return NULL;
 }
 
@@ -214,29 +326,41 @@ static ir_visitor_table_t ir_avexpr_table = {
   IRALL(IR_AVEXPR_FUNC)
 };
 
+static void ir_avexpr_step(ir_avexpr_t *visitor, ir_t *ir) {
+  bitset_copy(visitor->out, visitor->in);
+  ir_visit(visitor, ir);
+}
+
 static int ir_avexpr_transfer_bb(ir_avexpr_res_t *res, 
     LIST(ir_t*) *irs, ir_bb_t *bb) {
-  ir_avexpr_t visitor = {ir_avexpr_table, res, 0};
+  ir_avexpr_t visitor = {ir_avexpr_table, res, res->buf, res->next};
   int st = bb->range.start, ed = bb->range.end - 1;
-  hmap_copy(res->buf, BB_OUT(res, bb));
+  assert(!res->in_top[bb->no]);
+  bitset_copy(visitor.in, ABB_IN(res, bb));
   for (int i = st; i <= ed; ++i) {
-    visitor.index = i;
-    ir_avexpr_copy(res, i);
-    ir_visit(&visitor, irs->array[i]);
+    ir_avexpr_step(&visitor, irs->array[i]);
+    bitset_t *tmp = visitor.in;
+    visitor.in = visitor.out;
+    visitor.out = tmp;
+  }
+  if (res->out_top[bb->no] || bitset_cmp(visitor.in, ABB_OUT(res, bb))) {
+    res->out_top[bb->no] = 0;
+    bitset_copy(ABB_OUT(res, bb), visitor.in);
+    return 1;
   }
-  return hmap_cmp(res->buf, BB_OUT(res, bb));
+  return 0;
 }
 
 static int ir_avexpr_skip(ir_avexpr_res_t *res, ir_bb_t *bb) {
-  return BB_IN(res, bb)->is_top;
+  return res->in_top[bb->no];
 }
 
-static iropr_var_t *ir_avexpr_arth_get2(ir_avexpr_res_t *res, int index, ir_arth_t *gen) {
+static iropr_var_t *ir_avexpr_arth_get2(ir_avexpr_res_t *res, bitset_t *in, ir_arth_t *gen) {
   ir_arth_t target = {E_ir_arth, 0, gen->opr1, gen->opr2, gen->op};
   ir_arth_t arth = {E_ir_arth, 0, gen->opr2, (iropr_t *)&IMM0, OP2_PLUS};
   iropr_var_t *nrhs, *rv;
-  while ((rv = hmap_get(res->res[index].in, &target)) == NULL) {
-    if ((nrhs = hmap_get(res->res[index].in, &arth))) {
+  while ((rv = avexpr_get(res, in, &target)) == NULL) {
+    if ((nrhs = avexpr_get(res, in, &arth))) {
       arth.opr1 = (iropr_t *)nrhs;
       target.opr2 = (iropr_t *)nrhs;
     } else {
@@ -246,12 +370,12 @@ static iropr_var_t *ir_avexpr_arth_get2(ir_avexpr_res_t *res, int index, ir_arth
   return rv;
 }
 
-static iropr_var_t *ir_avexpr_get_arth(ir_avexpr_res_t *res, int index, ir_arth_t *gen) {
+static iropr_var_t *ir_avexpr_get_arth(ir_avexpr_res_t *res, bitset_t *in, ir_arth_t *gen) {
   ir_arth_t target = {E_ir_arth, 0, gen->opr1, gen->opr2, gen->op};
   ir_arth_t arth = {E_ir_arth, 0, gen->opr1, (iropr_t *)&IMM0, OP2_PLUS};
   iropr_var_t *nrhs, *rv;
-  while ((rv = ir_avexpr_arth_get2(res, index, &target)) == NULL) {
-    if ((nrhs = hmap_get(res->res[index].in, &arth))) {
+  while ((rv = ir_avexpr_arth_get2(res, in, &target)) == NULL) {
+    if ((nrhs = avexpr_get(res, in, &arth))) {
       arth.opr1 = (iropr_t *)nrhs;
       target.opr1 = (iropr_t *)nrhs;
     } else {
@@ -261,48 +385,47 @@ static iropr_var_t *ir_avexpr_get_arth(ir_avexpr_res_t *res, int index, ir_arth_
   return rv;
 }
 
-static void ir_avexpr_elim_bb(ir_cfg_t *cfg, ir_bb_t *bb) {
-  ir_avexpr_res_t *res = &cfg->avexpr_res;
-  LIST(ir_t*) *irs = cfg->irs;
-  int ed = bb->range.end - 1, st = bb->range.start;
-  for (int i = st; i <= ed; ++i) {
-    ir_t *ir = irs->array[i];
-    if (ir->irid == E_ir_arth) {
-      ir_arth_t *arth = (ir_arth_t *)ir;
-      iropr_var_t *get = ir_avexpr_get_arth(res, i, arth);
-      if (get) {
-        do_opt = 1;
-        if (same_iropr((iropr_t *)(arth->lhs), (iropr_t *)get)) {
-          ir->irid = E_ir_nop;
-        } else {
-          irs->array[i] = IRNEW(ir_mov, arth->lhs, (iropr_t *)get);
-        }
+static void ir_avexpr_elim(ir_cfg_t *cfg, bitset_t *in, int i) {
+  ir_t *ir = cfg->irs->array[i];
+  if (ir->irid == E_ir_arth) {
+    ir_arth_t *arth = (ir_arth_t *)ir;
+    iropr_var_t *get = ir_avexpr_get_arth(&cfg->avexpr_res, in, arth);
+    if (get) {
+      do_opt = 1;
+      if (same_iropr((iropr_t *)(arth->lhs), (iropr_t *)get)) {
+        ir_remove(cfg, i);
+      } else {
+        ir_replace(cfg, i, (ir_t *)IRNEW(ir_mov, arth->lhs, (iropr_t *)get));
       }
     }
   }
 }
 
-static iropr_t *reverse_fold(HMAP(ir_arth_t *, iropr_var_t *) *map, iropr_t *opr) {
+typedef struct ir_revefold {
+  void **table;
+  ir_avexpr_res_t *res;
+  bitset_t *in;
+  ir_cfg_t *cfg;
+  int index;
+} ir_revefold_t;
+
+static iropr_t *reverse_fold(ir_revefold_t *v, iropr_t *opr) {
   if (opr->oprid == E_iropr_imm) {
     return opr;
   }
   iropr_var_t *var = (iropr_var_t *)opr, *nvar;
   ir_arth_t arth = {E_ir_arth, var, (iropr_t *)var, (iropr_t *)&IMM0, OP2_PLUS};
-  while ((nvar = hmap_get(map, &arth))) {
+  while ((nvar = avexpr_get(v->res, v->in, &arth))) {
     var = nvar;
     arth.opr1 = (iropr_t *)nvar;
   }
   if (!same_iropr((iropr_t *)var, opr)) {
     do_opt = 1;
+    ir_touch(v->cfg, v->index);
   }
   return (iropr_t *)var;
 }
 
-typedef struct ir_revefold {
-  void **table;
-  HMAP(iropr_var_t *, iropr_var_t *) *in_map;
-} ir_revefold_t;
-
 DEF_VISIT_FUNC(ir_revefold, ir_nop) {
   return NULL;
 }
@@ -316,17 +439,23 @@ DEF_VISIT_FUNC(ir_revefold, ir_func) {
 }
 
 DEF_VISIT_FUNC(ir_revefold, ir_mov) {
-  n->rhs = reverse_fold(v->in_map, n->rhs);
+  n->rhs = reverse_fold(v, n->rhs);
   if (same_iropr((iropr_t *)(n->lhs), n->rhs)) {
     do_opt = 1;
-    n->irid = E_ir_nop;
+    ir_remove(v->cfg, v->index);
   }
   return NULL;
 }
 
 DEF_VISIT_FUNC(ir_revefold, ir_arth) {
-  n->opr1 = reverse_fold(v->in_map, n->opr1);
-  n->opr2 = reverse_fold(v->in_map, n->opr2);
+  n->opr1 = reverse_fold(v, n->opr1);
+  n->opr2 = reverse_fold(v, n->opr2);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_revefold, ir_set) {
+  n->opr1 = reverse_fold(v, n->opr1);
+  n->opr2 = reverse_fold(v, n->opr2);
   return NULL;
 }
 
@@ -335,15 +464,21 @@ DEF_VISIT_FUNC(ir_revefold, ir_addr) {
 }
 
 DEF_VISIT_FUNC(ir_revefold, ir_load) {
-  n->rhs = (iropr_var_t *)reverse_fold(v->in_map, (iropr_t *)n->rhs);
+  n->rhs = (iropr_var_t *)reverse_fold(v, (iropr_t *)n->rhs);
   assert(n->rhs->oprid == E_iropr_var);
   return NULL;
 }
 
 DEF_VISIT_FUNC(ir_revefold, ir_store) {
-  n->lhs = (iropr_var_t *)reverse_fold(v->in_map, (iropr_t *)n->lhs);
+  n->lhs = (iropr_var_t *)reverse_fold(v, (iropr_t *)n->lhs);
   assert(n->lhs->oprid == E_iropr_var);
-  n->rhs = reverse_fold(v->in_map, n->rhs);
+  n->rhs = reverse_fold(v, n->rhs);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_revefold, ir_memcpy) {
+  n->lhs = (iropr_var_t *)reverse_fold(v, (iropr_t *)n->lhs);
+  n->rhs = (iropr_var_t *)reverse_fold(v, (iropr_t *)n->rhs);
   return NULL;
 }
 
@@ -352,13 +487,13 @@ DEF_VISIT_FUNC(ir_revefold, ir_goto) {
 }
 
 DEF_VISIT_FUNC(ir_revefold, ir_branch) {
-  n->opr1 = reverse_fold(v->in_map, n->opr1);
-  n->opr2 = reverse_fold(v->in_map, n->opr2);
+  n->opr1 = reverse_fold(v, n->opr1);
+  n->opr2 = reverse_fold(v, n->opr2);
   return NULL;
 }
 
 DEF_VISIT_FUNC(ir_revefold, ir_ret) {
-  n->opr = reverse_fold(v->in_map, n->opr);
+  n->opr = reverse_fold(v, n->opr);
   return NULL;
 }
 
@@ -368,7 +503,7 @@ DEF_VISIT_FUNC(ir_revefold, ir_alloc) {
 
 DEF_VISIT_FUNC(ir_revefold, ir_call) {
   for (iroprs_t *l = n->args; l; l = l->next) {
-    l->opr = reverse_fold(v->in_map, l->opr);
+    l->opr = reverse_fold(v, l->opr);
   }
   return NULL;
 }
@@ -378,7 +513,7 @@ DEF_VISIT_FUNC(ir_revefold, ir_read) {
 }
 
 DEF_VISIT_FUNC(ir_revefold, ir_write) {
-  n->opr = reverse_fold(v->in_map, n->opr);
+  n->opr = reverse_fold(v, n->opr);
   return NULL;
 }
 
@@ -388,14 +523,25 @@ static ir_visitor_table_t ir_revefold_table = {
   IRALL(IR_REVEFOLD_FUNC)
 };
 
-static void ir_revefold_bb(ir_cfg_t *cfg, ir_bb_t *bb) {
-  ir_revefold_t visitor = {ir_revefold_table, NULL};
+static void ir_avexpr_elim_bb(ir_cfg_t *cfg, ir_bb_t *bb, int final) {
   ir_avexpr_res_t *res = &cfg->avexpr_res;
+  ir_avexpr_t visitor = {ir_avexpr_table, res, res->buf, res->next};
+  ir_revefold_t rvisitor = {ir_revefold_table, res, NULL, cfg, 0};
   LIST(ir_t*) *irs = cfg->irs;
   int st = bb->range.start, ed = bb->range.end - 1;
+  assert(!res->in_top[bb->no]);
+  bitset_copy(visitor.in, ABB_IN(res, bb));
   for (int i = st; i <= ed; ++i) {
-    visitor.in_map = res->res[i].in;
-    ir_visit(&visitor, irs->array[i]);
+    ir_avexpr_step(&visitor, irs->array[i]);
+    ir_avexpr_elim(cfg, visitor.in, i);
+    if (final) {
+      rvisitor.in = visitor.in;
+      rvisitor.index = i;
+      ir_visit(&rvisitor, irs->array[i]);
+    }
+    bitset_t *tmp = visitor.in;
+    visitor.in = visitor.out;
+    visitor.out = tmp;
   }
 }
 
@@ -406,10 +552,16 @@ int ir_avexpr(int final) {
   for (int i = 0; i < cfgs->size; ++i) {
     ir_cfg_t *cfg = cfgs->array[i];
     if (!cfg->reachable) continue;
-    ir_iter_cfg(cfg, &cfg->avexpr_res, cfg->avexpr_res.worklist,
-      ir_avexpr_meet, ir_avexpr_skip, ir_avexpr_transfer_bb, 1);
-    ir_analyse_cfg(cfg, ir_avexpr_elim_bb);
-    if (final) ir_analyse_cfg(cfg, ir_revefold_bb);
+    ir_avexpr_res_t *res = &cfg->avexpr_res;
+    ir_iter_cfg(cfg, res, res->worklist, ir_avexpr_meet, ir_avexpr_skip, 
+      ir_avexpr_transfer_bb, ir_avexpr_reset, 1, res->stamp);
+    res->stamp = program->stamp;
+    LIST(ir_bb_t*) *bbs = cfg->bbs;
+    for (int j = 0; j < bbs->size; ++j) {
+      ir_bb_t *bb = bbs->array[j];
+      if (!bb->reachable) continue;
+      ir_avexpr_elim_bb(cfg, bb, final);
+    }
   }
   return do_opt;
 }
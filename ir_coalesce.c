@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "ir_visitor.h"
+#include "ir.h"
+
+static int do_opt = 0;
+
+#define COALESCE_K UREG_NUM
+
+#define PIN_NONE  0
+#define PIN_PARAM 1 // may absorb other vars, but is never renamed
+#define PIN_MEM   2 // names a memory location, never coalesced
+
+typedef struct ir_coalesce_res {
+  int *var_no, var_num; // global var id -> local no, -1 = not in this cfg
+  iropr_var_t **vars;
+  int *alias, *pin, *degree;
+  bitset_t **adj;
+  int renamed;
+} ir_coalesce_res_t;
+
+static void ir_coalesce_walk(ir_cfg_t *cfg, ir_coalesce_res_t *res, 
+    void *func) {
+  LIST(ir_t*) *irs = cfg->irs;
+  for (int i = 0; i < irs->size; ++i) {
+    ir_opr_walk(irs->array[i], func, res);
+  }
+}
+
+static void number_opr(ir_coalesce_res_t *res, iropr_t **opr, opr_role_t role) {
+  if ((*opr)->oprid != E_iropr_var) return;
+  iropr_var_t *var = (iropr_var_t *)*opr;
+  if (res->var_no[var->id] < 0) {
+    res->var_no[var->id] = res->var_num;
+    res->vars[res->var_num++] = var;
+  }
+}
+
+static int find(ir_coalesce_res_t *res, int x) {
+  while (res->alias[x] != x) {
+    res->alias[x] = res->alias[res->alias[x]];
+    x = res->alias[x];
+  }
+  return x;
+}
+
+static void rename_opr(ir_coalesce_res_t *res, iropr_t **opr, opr_role_t role) {
+  if ((*opr)->oprid != E_iropr_var) return;
+  int no = res->var_no[((iropr_var_t *)*opr)->id], rep = find(res, no);
+  if (rep != no) {
+    *opr = (iropr_t *)res->vars[rep];
+    res->renamed = 1;
+  }
+}
+
+static void add_edge(ir_coalesce_res_t *res, int a, int b) {
+  if (a == b || bitset_test(res->adj[a], b)) return;
+  bitset_set(res->adj[a], b);
+  bitset_set(res->adj[b], a);
+  res->degree[a]++;
+  res->degree[b]++;
+}
+
+static void add_def(ir_coalesce_res_t *res, bitset_t *live,
+    iropr_var_t *def, iropr_t *copy) {
+  int d = res->var_no[def->id];
+  int c = copy && copy->oprid == E_iropr_var ?
+    ((iropr_var_t *)copy)->id : -1;
+  for (int id = bitset_next(live, 0); id >= 0; id = bitset_next(live, id + 1)) {
+    if (id != c && res->var_no[id] >= 0) {
+      add_edge(res, d, res->var_no[id]);
+    }
+  }
+}
+
+static void ir_coalesce_build(ir_cfg_t *cfg, ir_coalesce_res_t *res) {
+  ir_livevar_res_t *lvres = &cfg->livevar_res;
+  LIST(ir_t*) *irs = cfg->irs;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  for (int i = 0; i < irs->size; ++i) {
+    ir_t *ir = irs->array[i];
+    if (ir->irid == E_ir_func) {
+      ir_func_t *func = (ir_func_t *)ir;
+      for (iropr_vars_t *l = func->params; l; l = l->next) {
+        res->pin[res->var_no[l->opr->id]] = PIN_PARAM;
+        for (iropr_vars_t *l2 = func->params; l2 != l; l2 = l2->next) {
+          add_edge(res, res->var_no[l->opr->id], res->var_no[l2->opr->id]);
+        }
+      }
+    } else if (ir->irid == E_ir_alloc) {
+      res->pin[res->var_no[((ir_alloc_t *)ir)->opr->id]] = PIN_MEM;
+    } else if (ir->irid == E_ir_addr) {
+      res->pin[res->var_no[((ir_addr_t *)ir)->rhs->id]] = PIN_MEM;
+    }
+  }
+  for (int j = 0; j < bbs->size; ++j) {
+    ir_bb_t *bb = bbs->array[j];
+    if (!bb->reachable) continue;
+    int st = bb->range.start, ed = bb->range.end - 1;
+    for (int i = st; i <= ed; ++i) {
+      ir_t *ir = irs->array[i];
+      bitset_t *live = lvres->res[i].out;
+      switch (ir->irid) {
+      case E_ir_func:
+        for (iropr_vars_t *l = ((ir_func_t *)ir)->params; l; l = l->next) {
+          add_def(res, live, l->opr, NULL);
+        }
+        break;
+      case E_ir_mov:
+        add_def(res, live, ((ir_mov_t *)ir)->lhs, ((ir_mov_t *)ir)->rhs);
+        break;
+      case E_ir_arth: add_def(res, live, ((ir_arth_t *)ir)->lhs, NULL); break;
+      case E_ir_set: add_def(res, live, ((ir_set_t *)ir)->lhs, NULL); break;
+      case E_ir_addr: add_def(res, live, ((ir_addr_t *)ir)->lhs, NULL); break;
+      case E_ir_load: add_def(res, live, ((ir_load_t *)ir)->lhs, NULL); break;
+      case E_ir_alloc: add_def(res, live, ((ir_alloc_t *)ir)->opr, NULL); break;
+      case E_ir_call: add_def(res, live, ((ir_call_t *)ir)->ret, NULL); break;
+      case E_ir_read: add_def(res, live, ((ir_read_t *)ir)->opr, NULL); break;
+      default: ;
+      }
+    }
+  }
+}
+
+// Briggs: the merged node has fewer than K neighbours of significant degree
+static int briggs(ir_coalesce_res_t *res, int a, int b) {
+  int k = 0;
+  bitset_t *adj_a = res->adj[a], *adj_b = res->adj[b];
+  for (int t = bitset_next(adj_a, 0); t >= 0; t = bitset_next(adj_a, t + 1)) {
+    int deg = res->degree[t] - bitset_test(adj_b, t);
+    if (deg >= COALESCE_K) k++;
+  }
+  for (int t = bitset_next(adj_b, 0); t >= 0; t = bitset_next(adj_b, t + 1)) {
+    if (!bitset_test(adj_a, t) && res->degree[t] >= COALESCE_K) k++;
+  }
+  return k < COALESCE_K;
+}
+
+// George: every neighbour of a already interferes with b or is insignificant
+static int george(ir_coalesce_res_t *res, int a, int b) {
+  bitset_t *adj_a = res->adj[a];
+  for (int t = bitset_next(adj_a, 0); t >= 0; t = bitset_next(adj_a, t + 1)) {
+    if (!bitset_test(res->adj[b], t) && res->degree[t] >= COALESCE_K) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void merge(ir_coalesce_res_t *res, int rep, int other) {
+  bitset_t *adj_o = res->adj[other];
+  for (int t = bitset_next(adj_o, 0); t >= 0; t = bitset_next(adj_o, t + 1)) {
+    bitset_clear(res->adj[t], other);
+    if (bitset_test(res->adj[rep], t)) {
+      res->degree[t]--;
+    } else {
+      bitset_set(res->adj[t], rep);
+      bitset_set(res->adj[rep], t);
+      res->degree[rep]++;
+    }
+  }
+  bitset_zero(adj_o);
+  res->degree[other] = 0;
+  res->alias[other] = rep;
+  if (res->pin[other] == PIN_PARAM) res->pin[rep] = PIN_PARAM;
+}
+
+static int ir_coalesce_mov(ir_coalesce_res_t *res, ir_mov_t *mov) {
+  if (mov->rhs->oprid != E_iropr_var) return 0;
+  int a = find(res, res->var_no[mov->lhs->id]);
+  int b = find(res, res->var_no[((iropr_var_t *)mov->rhs)->id]);
+  if (a == b) return 0;
+  if (res->pin[a] == PIN_MEM || res->pin[b] == PIN_MEM) return 0;
+  if (res->pin[a] == PIN_PARAM && res->pin[b] == PIN_PARAM) return 0;
+  if (bitset_test(res->adj[a], b)) return 0;
+  if (!briggs(res, a, b) && !george(res, a, b) && !george(res, b, a)) return 0;
+  if (res->pin[b] == PIN_PARAM) {
+    merge(res, b, a);
+  } else {
+    merge(res, a, b);
+  }
+  return 1;
+}
+
+static void ir_coalesce_cfg(ir_cfg_t *cfg, int vars) {
+  ir_coalesce_res_t res = {malloc(vars * sizeof(int)), 0,
+    malloc(vars * sizeof(iropr_var_t *))};
+  memset(res.var_no, 0xff, vars * sizeof(int));
+  ir_coalesce_walk(cfg, &res, number_opr);
+  int n = res.var_num, merged = 0;
+  res.alias = malloc(n * sizeof(int));
+  res.pin = calloc(n, sizeof(int));
+  res.degree = calloc(n, sizeof(int));
+  res.adj = malloc(n * sizeof(bitset_t *));
+  for (int i = 0; i < n; ++i) {
+    res.alias[i] = i;
+    res.adj[i] = new_bitset(n, 0);
+  }
+  ir_coalesce_build(cfg, &res);
+  LIST(ir_t*) *irs = cfg->irs;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  for (int j = 0; j < bbs->size; ++j) {
+    ir_bb_t *bb = bbs->array[j];
+    if (!bb->reachable) continue;
+    for (int i = bb->range.start; i < bb->range.end; ++i) {
+      ir_t *ir = irs->array[i];
+      if (ir->irid == E_ir_mov) {
+        merged |= ir_coalesce_mov(&res, (ir_mov_t *)ir);
+      }
+    }
+  }
+  if (merged) {
+    do_opt = 1;
+    for (int i = 0; i < irs->size; ++i) {
+      res.renamed = 0;
+      ir_opr_walk(irs->array[i], rename_opr, &res);
+      if (res.renamed) ir_touch(cfg, i);
+    }
+    for (int i = 0; i < irs->size; ++i) {
+      ir_t *ir = irs->array[i];
+      if (ir->irid == E_ir_mov &&
+          same_iropr((iropr_t *)((ir_mov_t *)ir)->lhs, ((ir_mov_t *)ir)->rhs)) {
+        ir_remove(cfg, i);
+      }
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    free(res.adj[i]->array);
+    free(res.adj[i]);
+  }
+  free(res.adj);
+  free(res.degree);
+  free(res.pin);
+  free(res.alias);
+  free(res.vars);
+  free(res.var_no);
+}
+
+int ir_coalesce() {
+  ir_program_t *program = get_ir_program();
+  do_opt = 0;
+  LIST(ir_cfg_t*) *cfgs = program->cfgs;
+  for (int i = 0; i < cfgs->size; ++i) {
+    ir_cfg_t *cfg = cfgs->array[i];
+    if (!cfg->reachable) continue;
+    ir_coalesce_cfg(cfg, program->var_num);
+  }
+  return do_opt;
+}
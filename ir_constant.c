@@ -12,99 +12,202 @@
 #define CON2I(x) ((int)((uint64_t)(x) >> 32))
 #define ZERO     I2CON(0)
 
-static int inited = 0, do_opt = 0;
+static int do_opt = 0;
 
-static void ir_constant_reinit(ir_program_t *program) {
-  assert(inited);
-  LIST(ir_cfg_t*) *cfgs = program->cfgs;
-  for (int i = 0; i < cfgs->size; ++i) {
-    ir_cfg_t *cfg = cfgs->array[i];
-    if (!cfg->reachable) continue;
-    LIST(ir_bb_t*) *bbs = cfg->bbs;
-    ir_constant_res_t *res = &(cfg->constant_res);
-    assert(worklist_empty(res->worklist));
+static ir_cvec_t *new_cvec(int n) {
+  return NEW(ir_cvec, calloc(n, sizeof(ir_cval_t)), malloc(n * sizeof(int)), 0, 
+    new_bitset(n, 0));
+}
+
+static void free_cvec(ir_cvec_t *vec) {
+  if (vec == NULL) return;
+  free(vec->val);
+  free(vec->dirty);
+  free(vec->listed->array);
+  free(vec->listed);
+  free(vec);
+}
+
+static void cvec_set(ir_cvec_t *vec, int no, ir_cval_t val) {
+  if (val != UNDEF && !bitset_test(vec->listed, no)) {
+    bitset_set(vec->listed, no);
+    vec->dirty[vec->dirty_num++] = no;
+  }
+  vec->val[no] = val;
+}
+
+static void cvec_clear(ir_cvec_t *vec) {
+  for (int i = 0; i < vec->dirty_num; ++i) {
+    int no = vec->dirty[i];
+    vec->val[no] = UNDEF;
+    bitset_clear(vec->listed, no);
+  }
+  vec->dirty_num = 0;
+}
+
+static void cvec_copy(ir_cvec_t *dst, ir_cvec_t *src) {
+  cvec_clear(dst);
+  for (int i = 0; i < src->dirty_num; ++i) {
+    int no = src->dirty[i];
+    cvec_set(dst, no, src->val[no]);
+  }
+}
+
+static int cvec_cmp(ir_cvec_t *v1, ir_cvec_t *v2) {
+  for (int i = 0; i < v1->dirty_num; ++i) {
+    int no = v1->dirty[i];
+    if (v1->val[no] != v2->val[no]) return 1;
+  }
+  for (int i = 0; i < v2->dirty_num; ++i) {
+    int no = v2->dirty[i];
+    if (v1->val[no] != v2->val[no]) return 1;
+  }
+  return 0;
+}
+
+static void number_var(ir_constant_res_t *res, iropr_code_t var) {
+  int id = OPRC_VAR(var);
+  if (res->var_no[id] < 0) {
+    res->var_no[id] = res->var_num;
+    res->vars[res->var_num++] = id;
+  }
+}
+
+// Numbers are kept across runs so that a kept solution stays meaningful; a
+// var whose defs are gone keeps its number and stays UNDEF.
+static void ir_constant_number(ir_cfg_t *cfg, int vars) {
+  ir_constant_res_t *res = &(cfg->constant_res);
+  ir_code_t *code = res->code;
+  if (res->id_num < vars) {
+    res->var_no = realloc(res->var_no, vars * sizeof(int));
+    memset(res->var_no + res->id_num, 0xff, (vars - res->id_num) * sizeof(int));
+    res->vars = realloc(res->vars, vars * sizeof(int));
+    res->id_num = vars;
+  }
+  for (int i = 0; i < code->size; ++i) {
+    iropr_code_t *o = code->opr[i];
+    switch (code->op[i]) {
+    case E_ir_func: 
+      for (int k = o[1]; k < o[1] + o[2]; ++k) number_var(res, code->ext[k]);
+      break;
+    case E_ir_mov:
+    case E_ir_arth:
+    case E_ir_set:
+    case E_ir_addr:
+    case E_ir_load:
+    case E_ir_call:
+    case E_ir_read: number_var(res, o[0]); break;
+    default: ;
+    }
+  }
+}
+
+static void ir_constant_init_cfg(ir_cfg_t *cfg, int vars) {
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  ir_constant_res_t *res = &(cfg->constant_res);
+  ir_code_build(cfg);
+  res->code = &cfg->code;
+  ir_constant_number(cfg, vars);
+  if (res->var_num > res->var_cap || bbs->size != res->bb_num) {
+    for (int j = 0; j < res->bb_num; ++j) {
+      free_cvec(res->res[j].in);
+      free_cvec(res->res[j].out);
+    }
+    free_cvec(res->buf);
+    free(res->res);
+    free(res->pend_no);
+    free(res->pend_val);
+    res->var_cap = MAX(res->var_num, 1);
+    res->bb_num = bbs->size;
+    res->res = calloc(bbs->size, sizeof(ir_df_cvec_t));
+    res->buf = new_cvec(res->var_cap);
+    res->pend_no = malloc(res->var_cap * sizeof(int));
+    res->pend_val = malloc(res->var_cap * sizeof(ir_cval_t));
     for (int j = 0; j < bbs->size; ++j) {
-      ir_bb_t *bb = bbs->array[j];
-      if (!bb->reachable) continue;
-      int st = bb->range.start, ed = bb->range.end - 1;
-      hmap_removeall(res->res[st].in);
-      for (int k = st; k <= ed; ++k) {
-        hmap_removeall(res->res[k].out);
-        if (k != ed) assert(res->res[k + 1].in == res->res[k].out);
-      }
+      res->res[j].in = new_cvec(res->var_cap);
+      res->res[j].out = new_cvec(res->var_cap);
     }
+    res->stamp = 0;
   }
+  if (res->worklist == NULL || res->worklist->size != bbs->size) {
+    free(res->worklist);
+    res->worklist = new_worklist(bbs->size);
+  }
+  assert(worklist_empty(res->worklist) && res->worklist->size == bbs->size);
 }
 
 static void ir_constant_init(ir_program_t *program) {
   do_opt = 0;
-  if (inited) {
-    ir_constant_reinit(program);
-    return;
-  } else {
-    inited = 1;
-  }
   LIST(ir_cfg_t*) *cfgs = program->cfgs;
   for (int i = 0; i < cfgs->size; ++i) {
     ir_cfg_t *cfg = cfgs->array[i];
     if (!cfg->reachable) continue;
-    LIST(ir_bb_t*) *bbs = cfg->bbs;
-    ir_constant_res_t *res = &(cfg->constant_res);
-    res->res = calloc(cfg->irs->size + 1, sizeof(ir_df_map_t));
-    res->worklist = new_worklist(bbs->size);
-    res->buf = new_hmap(same_iropr, NULL, hash_iropr, 0);
-    for (int j = 0; j < bbs->size; ++j) {
-      ir_bb_t *bb = bbs->array[j];
-      if (!bb->reachable) continue;
-      int st = bb->range.start, ed = bb->range.end - 1;
-      res->res[st].in = new_hmap(same_iropr, NULL, hash_iropr, 0);
-      for (int k = st; k <= ed; ++k) {
-        res->res[k].out = new_hmap(same_iropr, NULL, hash_iropr, 0);
-        if (k != ed) res->res[k + 1].in = res->res[k].out;
-      }
-    }
+    ir_constant_init_cfg(cfg, program->var_num);
   }
 }
 
-static void ir_constant_copy(ir_constant_res_t *res, int index) {
-  hmap_copy(res->res[index].out, res->res[index].in);
-}
+#define CBB_IN(r, bb)  ((r)->res[(bb)->no].in)
+#define CBB_OUT(r, bb) ((r)->res[(bb)->no].out)
 
-static ir_cval_t map_get_constant(HMAP(iropr_var_t *, ir_cval_t) *map, iropr_t *opr) {
+static ir_cval_t cvec_get_constant(ir_constant_res_t *res, ir_cvec_t *vec, iropr_t *opr) {
   if (opr->oprid == E_iropr_imm) {
     return I2CON(((iropr_imm_t *)opr)->val);
   } else {
     assert(opr->oprid == E_iropr_var);
-    return hmap_get(map, opr);
+    int no = res->var_no[((iropr_var_t *)opr)->id];
+    return no < 0 ? UNDEF : vec->val[no];
+  }
+}
+
+static ir_cval_t get_constant(ir_constant_res_t *res, iropr_t *opr) {
+  return cvec_get_constant(res, res->buf, opr);
+}
+
+static ir_cval_t code_constant(ir_constant_res_t *res, iropr_code_t opr) {
+  if (OPRC_IS_IMM(opr)) return I2CON(oprc_imm(res->code, opr));
+  int no = res->var_no[OPRC_VAR(opr)];
+  return no < 0 ? UNDEF : res->buf->val[no];
+}
+
+static void set_constant(ir_constant_res_t *res, iropr_code_t opr, ir_cval_t val) {
+  int no = res->var_no[OPRC_VAR(opr)];
+  assert(no >= 0);
+  res->pend_no[res->pend_num] = no;
+  res->pend_val[res->pend_num++] = val;
+}
+
+static ir_cval_t get_pending(ir_constant_res_t *res, iropr_var_t *opr) {
+  int no = res->var_no[opr->id];
+  for (int i = 0; i < res->pend_num; ++i) {
+    if (res->pend_no[i] == no) return res->pend_val[i];
   }
+  return get_constant(res, (iropr_t *)opr);
 }
 
-static ir_cval_t get_constant(ir_constant_res_t *res, int index, iropr_t *opr) {
-  HMAP(iropr_var_t *, ir_cval_t) *map = res->res[index].in;
-  return map_get_constant(map, opr);
+static void ir_constant_commit(ir_constant_res_t *res) {
+  for (int i = 0; i < res->pend_num; ++i) {
+    cvec_set(res->buf, res->pend_no[i], res->pend_val[i]);
+  }
+  res->pend_num = 0;
 }
 
-static void set_constant(ir_constant_res_t *res, int index, 
-    iropr_var_t *opr, ir_cval_t val) {
-  HMAP(iropr_var_t *, ir_cval_t) *map = res->res[index].out;
-  hmap_put(map, opr, val);
+static iropr_t *cval_to_constant(ir_cval_t v, iropr_t *opr) {
+  if (ISCON(v)) {
+    do_opt = 1;
+    return (iropr_t *)IROPRNEW(iropr_imm, CON2I(v));
+  } else if (v == UNDEF) {
+    do_opt = 1;
+    return (iropr_t *)IROPRNEW(iropr_imm, 0);
+  } else {
+    return opr;
+  }
 }
 
-static iropr_t *to_constant(HMAP(iropr_var_t *, ir_cval_t) *map, iropr_t *opr) {
+static iropr_t *to_constant(ir_constant_res_t *res, iropr_t *opr) {
   if (opr->oprid == E_iropr_imm) {
     return opr;
   } else {
-    assert(opr->oprid == E_iropr_var);
-    ir_cval_t v = hmap_get(map, opr);
-    if (ISCON(v)) {
-      do_opt = 1;
-      return (iropr_t *)IROPRNEW(iropr_imm, CON2I(v));
-    } else if (v == UNDEF) {
-      do_opt = 1;
-      return (iropr_t *)IROPRNEW(iropr_imm, 0);
-    } else {
-      return opr;
-    }
+    return cval_to_constant(get_constant(res, opr), opr);
   }
 }
 
@@ -115,12 +218,12 @@ static ir_cval_t calc_constant(ir_cval_t v1, ir_cval_t v2, op2_t op, relop_t rel
     return UNDEF;
   }
   if (ISCON(v1) && ISCON(v2)) {
-    int x = CON2I(v1), y = CON2I(v2);
+    int x = CON2I(v1), y = CON2I(v2), r;
     switch (op) {
-    case OP2_PLUS: return I2CON(x + y);
-    case OP2_MINUS: return I2CON(x - y);
-    case OP2_STAR: return I2CON(x * y);
-    case OP2_DIV: return I2CON(x / y);
+    case OP2_PLUS:
+    case OP2_MINUS:
+    case OP2_STAR:
+    case OP2_DIV: return fold_const(op, x, y, &r) ? I2CON(r) : NAC;
     case OP2_RELOP: 
       switch (relop) {
       case GT: return I2CON(x > y);
@@ -140,7 +243,7 @@ static ir_cval_t calc_constant(ir_cval_t v1, ir_cval_t v2, op2_t op, relop_t rel
   }
 }
 
-static ir_cval_t consmap_comb(iropr_var_t *k, ir_cval_t v1, ir_cval_t v2) {
+static ir_cval_t cval_meet(ir_cval_t v1, ir_cval_t v2) {
   if (v1 == NAC || v2 == NAC) {
     return NAC;
   } else if (v1 == UNDEF) {
@@ -154,118 +257,99 @@ static ir_cval_t consmap_comb(iropr_var_t *k, ir_cval_t v1, ir_cval_t v2) {
   }
 }
 
-static void ir_constant_meet(ir_constant_res_t *res, ir_bb_t *dst, ir_bb_t *src) {
-  hmap_combine(BB_IN(res, dst), BB_OUT(res, src), consmap_comb);
-}
-
-typedef struct ir_constant {
-  void **table;
-  ir_constant_res_t *res;
-  int index;
-} ir_constant_t;
-
-DEF_VISIT_FUNC(ir_constant, ir_nop) {
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_label) {
-  assert(0);
+static void ir_constant_reset(ir_constant_res_t *res, ir_bb_t *bb) {
+  cvec_clear(CBB_IN(res, bb));
+  cvec_clear(CBB_OUT(res, bb));
 }
 
-DEF_VISIT_FUNC(ir_constant, ir_func) {
-  for (iropr_vars_t *l = n->params; l; l = l->next) {
-    set_constant(v->res, v->index, l->opr, NAC);
+static void ir_constant_meet(ir_constant_res_t *res, ir_bb_t *dst, ir_bb_t *src) {
+  ir_cvec_t *in = CBB_IN(res, dst), *out = CBB_OUT(res, src);
+  for (int i = 0; i < out->dirty_num; ++i) {
+    int no = out->dirty[i];
+    cvec_set(in, no, cval_meet(in->val[no], out->val[no]));
   }
-  return NULL;
 }
 
-DEF_VISIT_FUNC(ir_constant, ir_mov) {
-  set_constant(v->res, v->index, n->lhs, get_constant(v->res, v->index, n->rhs));
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_arth) {
-  if (n->op == OP2_MINUS && same_iropr(n->opr1, n->opr2)) {
-    set_constant(v->res, v->index, n->lhs, I2CON(0));
-  } else if (n->op == OP2_DIV && same_iropr(n->opr1, n->opr2)) {
-    set_constant(v->res, v->index, n->lhs, I2CON(1));
-  } else {
-    ir_cval_t v1 = get_constant(v->res, v->index, n->opr1), 
-              v2 = get_constant(v->res, v->index, n->opr2);
-    set_constant(v->res, v->index, n->lhs, calc_constant(v1, v2, n->op, 0));
+static int same_oprc(ir_code_t *code, iropr_code_t a, iropr_code_t b) {
+  if (a == b) return 1;
+  return OPRC_IS_IMM(a) && OPRC_IS_IMM(b) && oprc_imm(code, a) == oprc_imm(code, b);
+}
+
+// the values instruction i of the code defines, as pending ones
+static void ir_constant_transfer(ir_constant_res_t *res, int i) {
+  ir_code_t *code = res->code;
+  iropr_code_t *o = code->opr[i];
+  switch (code->op[i]) {
+  case E_ir_label: assert(0);
+  case E_ir_func:
+    for (int k = o[1]; k < o[1] + o[2]; ++k) set_constant(res, code->ext[k], NAC);
+    break;
+  case E_ir_mov: set_constant(res, o[0], code_constant(res, o[1])); break;
+  case E_ir_arth: {
+    op2_t op = code->sub[i];
+    if (op == OP2_MINUS && same_oprc(code, o[1], o[2])) {
+      set_constant(res, o[0], I2CON(0));
+    } else if (op == OP2_DIV && same_oprc(code, o[1], o[2])) {
+      set_constant(res, o[0], I2CON(1));
+    } else {
+      ir_cval_t v1 = code_constant(res, o[1]), v2 = code_constant(res, o[2]);
+      set_constant(res, o[0], calc_constant(v1, v2, op, 0));
+    }
+    break;
+  }
+  case E_ir_set: {
+    relop_t op = code->sub[i];
+    if (same_oprc(code, o[1], o[2])) {
+      set_constant(res, o[0], I2CON(eval_relop(op, 0, 0)));
+    } else {
+      ir_cval_t v1 = code_constant(res, o[1]), v2 = code_constant(res, o[2]);
+      set_constant(res, o[0], calc_constant(v1, v2, OP2_RELOP, op));
+    }
+    break;
+  }
+  case E_ir_addr:
+  case E_ir_load:
+  case E_ir_call:
+  case E_ir_read: set_constant(res, o[0], NAC); break;
+  default: ;
   }
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_addr) {
-  set_constant(v->res, v->index, n->lhs, NAC);
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_load) {
-  set_constant(v->res, v->index, n->lhs, NAC);
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_store) {
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_goto) {
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_branch) {
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_ret) {
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_alloc) {
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_call) {
-  set_constant(v->res, v->index, n->ret, NAC);
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_read) {
-  set_constant(v->res, v->index, n->opr, NAC);
-  return NULL;
-}
-
-DEF_VISIT_FUNC(ir_constant, ir_write) {
-  return NULL;
 }
 
-#define IR_CONSTANT_FUNC(name, ...) ir_constant_##name,
-
-static ir_visitor_table_t ir_constant_table = {
-  IRALL(IR_CONSTANT_FUNC)
-};
-
 static int ir_constant_transfer_bb(ir_constant_res_t *res, 
     LIST(ir_t*) *irs, ir_bb_t *bb) {
-  ir_constant_t visitor = {ir_constant_table, res, 0};
   int st = bb->range.start, ed = bb->range.end - 1;
-  hmap_copy(res->buf, BB_OUT(res, bb));
+  cvec_copy(res->buf, CBB_IN(res, bb));
   for (int i = st; i <= ed; ++i) {
-    visitor.index = i;
-    ir_constant_copy(res, i);
-    ir_visit(&visitor, irs->array[i]);
+    ir_constant_transfer(res, i);
+    ir_constant_commit(res);
+  }
+  if (cvec_cmp(res->buf, CBB_OUT(res, bb))) {
+    cvec_copy(CBB_OUT(res, bb), res->buf);
+    return 1;
   }
-  return hmap_cmp(res->buf, BB_OUT(res, bb));
+  return 0;
 }
 
 typedef struct ir_consfold {
   void **table;
-  HMAP(iropr_var_t *, ir_cval_t) *in_map, *out_map;
-  ir_t **ir_pos;
+  ir_constant_res_t *res;
+  ir_cfg_t *cfg;
+  int index;
 } ir_consfold_t;
 
+static iropr_t *fold_opr(ir_consfold_t *v, iropr_t *opr) {
+  iropr_t *res = to_constant(v->res, opr);
+  if (res != opr) ir_touch(v->cfg, v->index);
+  return res;
+}
+
+static void swap_opr(ir_consfold_t *v, iropr_t **opr1, iropr_t **opr2) {
+  iropr_t *opr = *opr1;
+  *opr1 = *opr2;
+  *opr2 = opr;
+  ir_touch(v->cfg, v->index);
+}
+
 DEF_VISIT_FUNC(ir_consfold, ir_nop) {
   return NULL;
 }
@@ -279,7 +363,7 @@ DEF_VISIT_FUNC(ir_consfold, ir_func) {
 }
 
 DEF_VISIT_FUNC(ir_consfold, ir_mov) {
-  n->rhs = to_constant(v->in_map, n->rhs);
+  n->rhs = fold_opr(v, n->rhs);
   return NULL;
 }
 
@@ -292,53 +376,49 @@ static ir_t *make_mov(iropr_var_t *lhs, iropr_t *rhs) {
 }
 
 DEF_VISIT_FUNC(ir_consfold, ir_arth) {
-  iropr_t *vlhs = to_constant(v->out_map, (iropr_t *)n->lhs);
+  iropr_t *vlhs = cval_to_constant(get_pending(v->res, n->lhs), (iropr_t *)n->lhs);
   if (vlhs->oprid == E_iropr_imm) {
-    v->ir_pos[0] = (ir_t *)IRNEW(ir_mov, n->lhs, vlhs);
+    ir_replace(v->cfg, v->index, (ir_t *)IRNEW(ir_mov, n->lhs, vlhs));
   } else {
-    n->opr1 = to_constant(v->in_map, n->opr1);
-    n->opr2 = to_constant(v->in_map, n->opr2);
+    n->opr1 = fold_opr(v, n->opr1);
+    n->opr2 = fold_opr(v, n->opr2);
     switch (n->op) {
     case OP2_PLUS:
       if (is_iropr_imm(n->opr1, 0)) {
         do_opt = 1;
-        v->ir_pos[0] = make_mov(n->lhs, n->opr2);
+        ir_replace(v->cfg, v->index, make_mov(n->lhs, n->opr2));
       } else if (is_iropr_imm(n->opr2, 0)) {
         do_opt = 1;
-        v->ir_pos[0] = make_mov(n->lhs, n->opr1);
+        ir_replace(v->cfg, v->index, make_mov(n->lhs, n->opr1));
       } else if (n->opr1->oprid == E_iropr_imm) {
-        iropr_t *opr = n->opr1;
-        n->opr1 = n->opr2;
-        n->opr2 = opr;
+        swap_opr(v, &n->opr1, &n->opr2);
       }
       break;
     case OP2_MINUS:
       if (is_iropr_imm(n->opr2, 0)) {
         do_opt = 1;
-        v->ir_pos[0] = make_mov(n->lhs, n->opr1);
+        ir_replace(v->cfg, v->index, make_mov(n->lhs, n->opr1));
       } else if (n->opr2->oprid == E_iropr_imm) {
         do_opt = 1;
         iropr_imm_t *imm = (iropr_imm_t *)(n->opr2);
         iropr_t *opr = (iropr_t *)IROPRNEW(iropr_imm, -imm->val);
-        v->ir_pos[0] = (ir_t *)IRNEW(ir_arth, n->lhs, n->opr1, opr, OP2_PLUS);
+        ir_replace(v->cfg, v->index, (ir_t *)IRNEW(ir_arth, n->lhs, n->opr1, opr, OP2_PLUS));
       }
       break;
     case OP2_STAR:
       if (is_iropr_imm(n->opr1, 2)) {
         do_opt = 1;
-        v->ir_pos[0] = (ir_t *)IRNEW(ir_arth, n->lhs, n->opr2, n->opr2, OP2_PLUS);
+        ir_replace(v->cfg, v->index, (ir_t *)IRNEW(ir_arth, n->lhs, n->opr2, n->opr2, OP2_PLUS));
       } else if (is_iropr_imm(n->opr2, 2)) {
         do_opt = 1;
-        v->ir_pos[0] = (ir_t *)IRNEW(ir_arth, n->lhs, n->opr1, n->opr1, OP2_PLUS);
+        ir_replace(v->cfg, v->index, (ir_t *)IRNEW(ir_arth, n->lhs, n->opr1, n->opr1, OP2_PLUS));
       } else if (n->opr1->oprid == E_iropr_imm) {
-        iropr_t *opr = n->opr1;
-        n->opr1 = n->opr2;
-        n->opr2 = opr;
+        swap_opr(v, &n->opr1, &n->opr2);
       }
     case OP2_DIV:
       if (is_iropr_imm(n->opr2, 1)) {
         do_opt = 1;
-        v->ir_pos[0] = make_mov(n->lhs, n->opr1);
+        ir_replace(v->cfg, v->index, make_mov(n->lhs, n->opr1));
       }
       break;
     default: assert(0);
@@ -347,6 +427,23 @@ DEF_VISIT_FUNC(ir_consfold, ir_arth) {
   return NULL;
 }
 
+DEF_VISIT_FUNC(ir_consfold, ir_set) {
+  iropr_t *vlhs = cval_to_constant(get_pending(v->res, n->lhs), (iropr_t *)n->lhs);
+  if (vlhs->oprid == E_iropr_imm) {
+    ir_replace(v->cfg, v->index, (ir_t *)IRNEW(ir_mov, n->lhs, vlhs));
+  } else {
+    n->opr1 = fold_opr(v, n->opr1);
+    n->opr2 = fold_opr(v, n->opr2);
+    if (n->opr1->oprid == E_iropr_imm) {
+      swap_opr(v, &n->opr1, &n->opr2);
+      if (n->op <= 3) {
+        n->op = 3 - n->op;
+      }
+    }
+  }
+  return NULL;
+}
+
 DEF_VISIT_FUNC(ir_consfold, ir_addr) {
   return NULL;
 }
@@ -356,7 +453,11 @@ DEF_VISIT_FUNC(ir_consfold, ir_load) {
 }
 
 DEF_VISIT_FUNC(ir_consfold, ir_store) {
-  n->rhs = to_constant(v->in_map, n->rhs);
+  n->rhs = fold_opr(v, n->rhs);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(ir_consfold, ir_memcpy) {
   return NULL;
 }
 
@@ -365,25 +466,23 @@ DEF_VISIT_FUNC(ir_consfold, ir_goto) {
 }
 
 DEF_VISIT_FUNC(ir_consfold, ir_branch) {
-  ir_cval_t v1 = map_get_constant(v->in_map, n->opr1),
-            v2 = map_get_constant(v->in_map, n->opr2);
+  ir_cval_t v1 = get_constant(v->res, n->opr1),
+            v2 = get_constant(v->res, n->opr2);
   ir_cval_t val = calc_constant(v1, v2, OP2_RELOP, n->op);
   if (val == UNDEF || (ISCON(val) && CON2I(val) == 0)) {
     do_opt = 1;
-    remove_branch_goto((ir_t *)n);
+    ir_remove(v->cfg, v->index);
   } else if (ISCON(val)) {
     do_opt = 1;
     ir_goto_t *newir = IRNEW(ir_goto, n->label);
     add_branch_goto((ir_t *)newir);
-    v->ir_pos[0] = (ir_t *)newir;
+    ir_replace(v->cfg, v->index, (ir_t *)newir);
     remove_branch_goto((ir_t *)n);
   } else {
-    n->opr1 = to_constant(v->in_map, n->opr1);
-    n->opr2 = to_constant(v->in_map, n->opr2);
+    n->opr1 = fold_opr(v, n->opr1);
+    n->opr2 = fold_opr(v, n->opr2);
     if (n->opr1->oprid == E_iropr_imm) {
-      iropr_t *opr = n->opr1;
-      n->opr1 = n->opr2;
-      n->opr2 = opr;
+      swap_opr(v, &n->opr1, &n->opr2);
       if (n->op <= 3) {
         n->op = 3 - n->op;
       }
@@ -393,7 +492,7 @@ DEF_VISIT_FUNC(ir_consfold, ir_branch) {
 }
 
 DEF_VISIT_FUNC(ir_consfold, ir_ret) {
-  n->opr = to_constant(v->in_map, n->opr);
+  n->opr = fold_opr(v, n->opr);
   return NULL;
 }
 
@@ -403,7 +502,7 @@ DEF_VISIT_FUNC(ir_consfold, ir_alloc) {
 
 DEF_VISIT_FUNC(ir_consfold, ir_call) {
   for (iroprs_t *l = n->args; l; l = l->next) {
-    l->opr = to_constant(v->in_map, l->opr);
+    l->opr = fold_opr(v, l->opr);
   }
   return NULL;
 }
@@ -413,7 +512,7 @@ DEF_VISIT_FUNC(ir_consfold, ir_read) {
 }
 
 DEF_VISIT_FUNC(ir_consfold, ir_write) {
-  n->opr = to_constant(v->in_map, n->opr);
+  n->opr = fold_opr(v, n->opr);
   return NULL;
 }
 
@@ -424,15 +523,16 @@ static ir_visitor_table_t ir_consfold_table = {
 };
 
 static void ir_consfold_bb(ir_cfg_t *cfg, ir_bb_t *bb) {
-  ir_consfold_t visitor = {ir_consfold_table, NULL, NULL, NULL};
   ir_constant_res_t *res = &cfg->constant_res;
+  ir_consfold_t visitor = {ir_consfold_table, res, cfg, 0};
   LIST(ir_t*) *irs = cfg->irs;
   int st = bb->range.start, ed = bb->range.end - 1;
+  cvec_copy(res->buf, CBB_IN(res, bb));
   for (int i = st; i <= ed; ++i) {
-    visitor.in_map = res->res[i].in;
-    visitor.out_map = res->res[i].out;
-    visitor.ir_pos = (ir_t **)&(irs->array[i]);
+    ir_constant_transfer(res, i);
+    visitor.index = i;
     ir_visit(&visitor, irs->array[i]);
+    ir_constant_commit(res);
   }
 }
 
@@ -443,10 +543,11 @@ int ir_constant() {
   for (int i = 0; i < cfgs->size; ++i) {
     ir_cfg_t *cfg = cfgs->array[i];
     if (!cfg->reachable) continue;
-    ir_iter_cfg(cfg, &cfg->constant_res, cfg->constant_res.worklist,
-      ir_constant_meet, NULL, ir_constant_transfer_bb, 1);
+    ir_constant_res_t *res = &cfg->constant_res;
+    ir_iter_cfg(cfg, res, res->worklist, ir_constant_meet, NULL, 
+      ir_constant_transfer_bb, ir_constant_reset, 1, res->stamp);
+    res->stamp = program->stamp;
     ir_analyse_cfg(cfg, ir_consfold_bb);
-    build_cfg(cfg);
   }
   check_program_reachable();
   return do_opt;
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "ir_visitor.h"
+#include "ir.h"
+
+static int do_opt = 0;
+
+// Dead store elimination over the words of ir_alloc objects.  A backward
+// liveness of words, keyed by object and offset from ir_alias, finds
+// stores whose word is overwritten or never read again; stack objects die
+// at return.  Calls and loads through untracked pointers read every word
+// of the escaped objects.
+
+typedef struct ir_dse {
+  ir_cfg_t *cfg;
+  int *base;           // first word of an object, indexed by its var id
+  int *size;           // its number of words
+  bitset_t *escaped;   // words of escaped objects
+  bitset_t **in;       // per block, the exit last
+  bitset_t *live;
+  int word_num, word_cap, in_num, cap;
+} ir_dse_t;
+
+static ir_dse_t dse;
+
+static bitset_t *grow(bitset_t *bs, int n) {
+  if (bs == NULL) return new_bitset(n, 0);
+  bitset_resize(bs, n);
+  bitset_zero(bs);
+  return bs;
+}
+
+// first of the len bytes accessed through ptr, -1 if unknown; *obj gets
+// the object or PT_ANY
+static int span_of(ir_dse_t *d, iropr_var_t *ptr, int len, int *obj) {
+  ir_alias_t *a = &d->cfg->alias;
+  int o = a->obj[ptr->id], off = a->off[ptr->id];
+  if (o < 0 || d->size[o] == 0) {
+    *obj = PT_ANY;
+    return -1;
+  }
+  *obj = o;
+  if (off == OFF_ANY || off % 4 != 0 || off < 0) return -1;
+  if (off / 4 + (len + 3) / 4 > d->size[o]) return -1;
+  return d->base[o] + off / 4;
+}
+
+static void gen_obj(ir_dse_t *d, bitset_t *live, int obj) {
+  if (obj == PT_ANY) {
+    bitset_or(live, d->escaped);
+    return;
+  }
+  for (int w = 0; w < d->size[obj]; ++w) bitset_set(live, d->base[obj] + w);
+}
+
+static int obj_live(ir_dse_t *d, bitset_t *live, int obj) {
+  for (int w = 0; w < d->size[obj]; ++w) {
+    if (bitset_test(live, d->base[obj] + w)) return 1;
+  }
+  return 0;
+}
+
+// a write of n words from w into obj; returns 1 if none of them is read
+static int kill_span(ir_dse_t *d, bitset_t *live, int obj, int w, int n) {
+  if (obj == PT_ANY) return 0;
+  if (w < 0) return !obj_live(d, live, obj);
+  int dead = 1;
+  for (int k = w; k < w + n; ++k) {
+    if (bitset_test(live, k)) dead = 0;
+  }
+  if (dead) return 1;
+  for (int k = w; k < w + n; ++k) bitset_clear(live, k);
+  return 0;
+}
+
+static void gen_span(ir_dse_t *d, bitset_t *live, int obj, int w, int n) {
+  if (w < 0) {
+    gen_obj(d, live, obj);
+  } else {
+    for (int k = w; k < w + n; ++k) bitset_set(live, k);
+  }
+}
+
+// live words before ir given those after it; returns 1 if ir is a dead store
+static int transfer(ir_dse_t *d, bitset_t *live, ir_t *ir) {
+  int obj, w;
+  switch (ir->irid) {
+  case E_ir_store:
+    w = span_of(d, ((ir_store_t *)ir)->lhs, 4, &obj);
+    return kill_span(d, live, obj, w, 1);
+  case E_ir_memcpy: {
+    ir_memcpy_t *copy = (ir_memcpy_t *)ir;
+    int n = (copy->size + 3) / 4;
+    w = span_of(d, copy->lhs, copy->size, &obj);
+    if (kill_span(d, live, obj, w, n)) return 1;
+    w = span_of(d, copy->rhs, copy->size, &obj);
+    gen_span(d, live, obj, w, n);
+    return 0;
+  }
+  case E_ir_load:
+    w = span_of(d, ((ir_load_t *)ir)->rhs, 4, &obj);
+    gen_span(d, live, obj, w, 1);
+    return 0;
+  case E_ir_call: bitset_or(live, d->escaped); return 0;
+  case E_ir_ret: bitset_zero(live); return 0;
+  default: return 0;
+  }
+}
+
+static void ir_dse_bb(ir_dse_t *d, ir_bb_t *bb, bitset_t *live, int elim) {
+  LIST(ir_t*) *irs = d->cfg->irs;
+  bitset_zero(live);
+  for (int j = 0; j < bb->outs->size; ++j) {
+    bitset_or(live, d->in[((ir_bb_t *)bb->outs->array[j])->no]);
+  }
+  for (int i = bb->range.end - 1; i >= bb->range.start; --i) {
+    if (transfer(d, live, irs->array[i]) && elim) {
+      ir_remove(d->cfg, i);
+      do_opt = 1;
+    }
+  }
+}
+
+static void ir_dse_cfg(ir_dse_t *d, ir_cfg_t *cfg) {
+  LIST(ir_t*) *irs = cfg->irs;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  d->cfg = cfg;
+  d->word_num = 0;
+  for (int i = 0; i < irs->size; ++i) {
+    ir_t *ir = irs->array[i];
+    if (ir->irid != E_ir_alloc) continue;
+    ir_alloc_t *alloc = (ir_alloc_t *)ir;
+    d->base[alloc->opr->id] = d->word_num;
+    d->size[alloc->opr->id] = (alloc->size + 3) / 4;
+    d->word_num += (alloc->size + 3) / 4;
+  }
+  if (d->word_num == 0) return;
+  ir_alias_build(cfg);
+  if (d->word_cap < d->word_num) d->word_cap = d->word_num;
+  int n = d->word_cap; // all sets share one size
+  d->escaped = grow(d->escaped, n);
+  d->live = grow(d->live, n);
+  for (int i = 0; i < irs->size; ++i) {
+    ir_t *ir = irs->array[i];
+    if (ir->irid != E_ir_alloc) continue;
+    int obj = ((ir_alloc_t *)ir)->opr->id;
+    if (cfg->alias.escaped[obj]) gen_obj(d, d->escaped, obj);
+  }
+  if (d->in_num < bbs->size + 1) {
+    d->in = realloc(d->in, (bbs->size + 1) * sizeof(bitset_t *));
+    for (int b = d->in_num; b < bbs->size + 1; ++b) d->in[b] = NULL;
+    d->in_num = bbs->size + 1;
+  }
+  for (int b = 0; b <= bbs->size; ++b) d->in[b] = grow(d->in[b], n);
+  for (int changed = 1; changed; ) {
+    changed = 0;
+    for (int b = bbs->size - 1; b >= 0; --b) {
+      ir_bb_t *bb = bbs->array[b];
+      if (!bb->reachable) continue;
+      ir_dse_bb(d, bb, d->live, 0);
+      if (bitset_cmp(d->in[b], d->live)) {
+        bitset_copy(d->in[b], d->live);
+        changed = 1;
+      }
+    }
+  }
+  for (int b = 0; b < bbs->size; ++b) {
+    ir_bb_t *bb = bbs->array[b];
+    if (bb->reachable) ir_dse_bb(d, bb, d->live, 1);
+  }
+}
+
+int ir_dse() {
+  ir_program_t *program = get_ir_program();
+  ir_dse_t *d = &dse;
+  do_opt = 0;
+  if (d->cap < program->var_num) {
+    d->cap = program->var_num;
+    d->base = realloc(d->base, d->cap * sizeof(int));
+    d->size = realloc(d->size, d->cap * sizeof(int));
+  }
+  memset(d->size, 0, program->var_num * sizeof(int));
+  LIST(ir_cfg_t*) *cfgs = program->cfgs;
+  for (int i = 0; i < cfgs->size; ++i) {
+    ir_cfg_t *cfg = cfgs->array[i];
+    if (!cfg->reachable) continue;
+    ir_dse_cfg(d, cfg);
+  }
+  return do_opt;
+}
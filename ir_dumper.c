@@ -7,6 +7,7 @@
 typedef struct ir_dumper {
   void **table;
   FILE *fp;
+  int label; // next label for ir_set, above every real one
 } ir_dumper_t;
 
 static void dump_opr(ir_dumper_t *v, iropr_t *opr) {
@@ -56,6 +57,23 @@ DEF_VISIT_FUNC(ir_dumper, ir_arth) {
   return NULL;
 }
 
+// no set in the text format either: branch over a scratch var, as the
+// lhs may be an operand; the label is the dumper's own, so dumping does
+// not change the program
+DEF_VISIT_FUNC(ir_dumper, ir_set) {
+  int t = get_ir_program()->var_num, label = v->label++;
+  fprintf(v->fp, "v%d := #1\n", t);
+  fprintf(v->fp, "IF ");
+  dump_opr(v, n->opr1);
+  fprintf(v->fp, " %s ", ((char *[]){">", "<=", ">=", "<", "==", "!="})[n->op]);
+  dump_opr(v, n->opr2);
+  fprintf(v->fp, " GOTO .L%d\n", label);
+  fprintf(v->fp, "v%d := #0\n", t);
+  fprintf(v->fp, "LABEL .L%d :\n", label);
+  fprintf(v->fp, "v%d := v%d\n", n->lhs->id, t);
+  return NULL;
+}
+
 DEF_VISIT_FUNC(ir_dumper, ir_addr) {
   fprintf(v->fp, "v%d := &v%d\n", n->lhs->id, n->rhs->id);
   return NULL;
@@ -73,6 +91,19 @@ DEF_VISIT_FUNC(ir_dumper, ir_store) {
   return NULL;
 }
 
+// the text format has no block copy: spell it out word by word through
+// two scratch vars past the last real one
+DEF_VISIT_FUNC(ir_dumper, ir_memcpy) {
+  int t = get_ir_program()->var_num;
+  for (int i = 0; i < n->size; i += 4) {
+    fprintf(v->fp, "v%d := v%d + #%d\n", t, n->rhs->id, i);
+    fprintf(v->fp, "v%d := *v%d\n", t + 1, t);
+    fprintf(v->fp, "v%d := v%d + #%d\n", t, n->lhs->id, i);
+    fprintf(v->fp, "*v%d := v%d\n", t, t + 1);
+  }
+  return NULL;
+}
+
 DEF_VISIT_FUNC(ir_dumper, ir_goto) {
   assert(n->label->irid == E_ir_label);
   fprintf(v->fp, "GOTO .L%d\n", n->label->label);
@@ -145,7 +176,7 @@ int ir_dump(const char *file) {
     perror(file);
     return 1;
   }
-  ir_dumper = (ir_dumper_t) {ir_dumper_table, fp};
+  ir_dumper = (ir_dumper_t) {ir_dumper_table, fp, get_ir_program()->label_num};
   ir_hole(hole_dump_ir, 1);
   fclose(fp);
   return 0;
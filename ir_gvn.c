@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "ir_visitor.h"
+#include "ir.h"
+
+static int do_opt = 0;
+
+// Dominator-tree value numbering; memory words a single-pred block
+// inherits from its dominator parent only forward constants.
+
+#define VN_NIL (-1)
+
+typedef struct ir_gvn_mem {
+  int addr_vn, ptr, val_vn; // ptr: a var that held the address
+  int inherited;
+} ir_gvn_mem_t;
+
+typedef struct ir_gvn {
+  ir_cfg_t *cfg;
+  HMAP(uint64_t, int) *table; // packed expression -> vn + 1
+  int vn_num, vn_cap;
+  char *is_const;
+  int *const_val;
+  iropr_var_t **scoped_leader, **local_leader; // indexed by vn
+  int var_cap;
+  char *single;
+  int *scoped_vn, *local_vn; // indexed by var id
+  // undo log of the scoped tables: var id, or ~vn for a leader
+  int *log, log_num, log_cap;
+  // what to clear at the end of a block: var id, or ~vn for a leader
+  int *local, local_num, local_cap;
+  // words known in memory, and the saved tables of the open blocks
+  ir_gvn_mem_t *mem, *saved;
+  int mem_num, mem_cap, saved_num, saved_cap;
+  int index, changed;
+} ir_gvn_t;
+
+static ir_gvn_t gvn;
+
+static int same_key(void *a, void *b) {
+  return a == b;
+}
+
+static uint64_t hash_key(void *a) {
+  return ((uint64_t)a * 0x9e3779b97f4a7c15ULL) >> 16;
+}
+
+static void push(int **arr, int *num, int *cap, int x) {
+  if (*num == *cap) {
+    *cap = *cap ? *cap * 2 : 64;
+    *arr = realloc(*arr, *cap * sizeof(int));
+  }
+  (*arr)[(*num)++] = x;
+}
+
+static void push_mem(ir_gvn_mem_t **arr, int *num, int *cap, ir_gvn_mem_t x) {
+  if (*num == *cap) {
+    *cap = *cap ? *cap * 2 : 64;
+    *arr = realloc(*arr, *cap * sizeof(ir_gvn_mem_t));
+  }
+  (*arr)[(*num)++] = x;
+}
+
+static int new_vn(ir_gvn_t *g) {
+  if (g->vn_num == g->vn_cap) {
+    g->vn_cap = g->vn_cap ? g->vn_cap * 2 : 256;
+    g->is_const = realloc(g->is_const, g->vn_cap);
+    g->const_val = realloc(g->const_val, g->vn_cap * sizeof(int));
+    g->scoped_leader = realloc(g->scoped_leader, g->vn_cap * sizeof(iropr_var_t *));
+    g->local_leader = realloc(g->local_leader, g->vn_cap * sizeof(iropr_var_t *));
+  }
+  int vn = g->vn_num++;
+  g->is_const[vn] = 0;
+  g->scoped_leader[vn] = NULL;
+  g->local_leader[vn] = NULL;
+  return vn;
+}
+
+static int keyed_vn(ir_gvn_t *g, uint64_t key) {
+  int vn = (int)(uint64_t)hmap_get(g->table, (void *)key) - 1;
+  if (vn < 0) {
+    vn = new_vn(g);
+    hmap_put(g->table, (void *)key, (void *)(uint64_t)(vn + 1));
+  }
+  return vn;
+}
+
+static int const_vn(ir_gvn_t *g, int val) {
+  int vn = keyed_vn(g, 1ULL << 63 | (uint32_t)val);
+  g->is_const[vn] = 1;
+  g->const_val[vn] = val;
+  return vn;
+}
+
+static iropr_var_t *leader(ir_gvn_t *g, int vn) {
+  return g->scoped_leader[vn] ? g->scoped_leader[vn] : g->local_leader[vn];
+}
+
+// number var currently holds, VN_NIL if unknown
+static int peek_var(ir_gvn_t *g, int id) {
+  if (g->local_vn[id] != VN_NIL) return g->local_vn[id];
+  return g->single[id] ? g->scoped_vn[id] : VN_NIL;
+}
+
+static int vn_of(ir_gvn_t *g, iropr_t *opr) {
+  if (opr->oprid == E_iropr_imm) return const_vn(g, ((iropr_imm_t *)opr)->val);
+  int id = ((iropr_var_t *)opr)->id, vn = peek_var(g, id);
+  if (vn == VN_NIL) {
+    vn = new_vn(g);
+    g->local_vn[id] = vn;
+    push(&g->local, &g->local_num, &g->local_cap, id);
+  }
+  return vn;
+}
+
+static int arth_vn(ir_gvn_t *g, op2_t op, int a, int b) {
+  int ca = g->is_const[a], cb = g->is_const[b], r;
+  int x = ca ? g->const_val[a] : 0, y = cb ? g->const_val[b] : 0;
+  if (ca && cb && fold_const(op, x, y, &r)) return const_vn(g, r);
+  switch (op) {
+  case OP2_PLUS:
+    if (ca && x == 0) return b;
+    if (cb && y == 0) return a;
+    break;
+  case OP2_MINUS:
+    if (cb && y == 0) return a;
+    if (a == b) return const_vn(g, 0);
+    break;
+  case OP2_STAR:
+    if ((ca && x == 0) || (cb && y == 0)) return const_vn(g, 0);
+    if (ca && x == 1) return b;
+    if (cb && y == 1) return a;
+    break;
+  case OP2_DIV:
+    if (cb && y == 1) return a;
+    break;
+  default: assert(0);
+  }
+  if ((op == OP2_PLUS || op == OP2_STAR) && a > b) {
+    int t = a; a = b; b = t;
+  }
+  return keyed_vn(g, (uint64_t)op << 58 | (uint64_t)a << 29 | (uint64_t)b);
+}
+
+// var now holds vn
+static void def_var(ir_gvn_t *g, iropr_var_t *var, int vn) {
+  int id = var->id;
+  if (g->single[id]) {
+    g->local_vn[id] = VN_NIL;
+    g->scoped_vn[id] = vn;
+    push(&g->log, &g->log_num, &g->log_cap, id);
+    if (!g->is_const[vn] && leader(g, vn) == NULL) {
+      g->scoped_leader[vn] = var;
+      push(&g->log, &g->log_num, &g->log_cap, ~vn);
+    }
+    return;
+  }
+  int old = g->local_vn[id];
+  if (old != VN_NIL && g->local_leader[old] && g->local_leader[old]->id == id) {
+    g->local_leader[old] = NULL;
+  }
+  if (old == VN_NIL) push(&g->local, &g->local_num, &g->local_cap, id);
+  g->local_vn[id] = vn;
+  if (!g->is_const[vn] && leader(g, vn) == NULL) {
+    g->local_leader[vn] = var;
+    push(&g->local, &g->local_num, &g->local_cap, ~vn);
+  }
+}
+
+static void subst_opr(ir_gvn_t *g, iropr_t **opr, opr_role_t role) {
+  if (role != E_opr_use || (*opr)->oprid != E_iropr_var) return;
+  int vn = peek_var(g, ((iropr_var_t *)*opr)->id);
+  if (vn != VN_NIL && g->is_const[vn]) {
+    *opr = (iropr_t *)IROPRNEW(iropr_imm, g->const_val[vn]);
+    g->changed = 1;
+  }
+}
+
+static void fresh_def(ir_gvn_t *g, iropr_t **opr, opr_role_t role) {
+  if (role == E_opr_def) def_var(g, (iropr_var_t *)*opr, new_vn(g));
+}
+
+static void gvn_mov(ir_gvn_t *g, ir_mov_t *mov) {
+  int vn = vn_of(g, mov->rhs);
+  if (peek_var(g, mov->lhs->id) == vn) {
+    ir_remove(g->cfg, g->index);
+    do_opt = 1;
+    return;
+  }
+  def_var(g, mov->lhs, vn);
+}
+
+static void gvn_arth(ir_gvn_t *g, ir_arth_t *arth) {
+  int a = vn_of(g, arth->opr1), b = vn_of(g, arth->opr2);
+  int vn = arth_vn(g, arth->op, a, b);
+  iropr_t *to = NULL;
+  if (g->is_const[vn]) {
+    to = (iropr_t *)IROPRNEW(iropr_imm, g->const_val[vn]);
+  } else if (leader(g, vn)) {
+    to = (iropr_t *)leader(g, vn);
+  } else if (vn == a && arth->opr1->oprid == E_iropr_var) {
+    to = arth->opr1;
+  } else if (vn == b && arth->opr2->oprid == E_iropr_var) {
+    to = arth->opr2;
+  }
+  if (to && same_iropr(to, (iropr_t *)arth->lhs)) {
+    ir_remove(g->cfg, g->index);
+    do_opt = 1;
+    return;
+  }
+  if (to) {
+    ir_replace(g->cfg, g->index, (ir_t *)IRNEW(ir_mov, arth->lhs, to));
+    do_opt = 1;
+  }
+  def_var(g, arth->lhs, vn);
+}
+
+// comparisons are keyed past the op2_t range, on the relop
+static void gvn_set(ir_gvn_t *g, ir_set_t *set) {
+  int a = vn_of(g, set->opr1), b = vn_of(g, set->opr2), vn;
+  if (g->is_const[a] && g->is_const[b]) {
+    vn = const_vn(g, eval_relop(set->op, g->const_val[a], g->const_val[b]));
+  } else if (a == b) {
+    vn = const_vn(g, eval_relop(set->op, 0, 0));
+  } else {
+    uint64_t op = OP2_DIV + 1 + set->op;
+    vn = keyed_vn(g, op << 58 | (uint64_t)a << 29 | (uint64_t)b);
+  }
+  iropr_t *to = NULL;
+  if (g->is_const[vn]) {
+    to = (iropr_t *)IROPRNEW(iropr_imm, g->const_val[vn]);
+  } else if (leader(g, vn)) {
+    to = (iropr_t *)leader(g, vn);
+  }
+  if (to && same_iropr(to, (iropr_t *)set->lhs)) {
+    ir_remove(g->cfg, g->index);
+    do_opt = 1;
+    return;
+  }
+  if (to) {
+    ir_replace(g->cfg, g->index, (ir_t *)IRNEW(ir_mov, set->lhs, to));
+    do_opt = 1;
+  }
+  def_var(g, set->lhs, vn);
+}
+
+// entry of the word at the address in ptr, NULL if unknown
+static ir_gvn_mem_t *find_mem(ir_gvn_t *g, iropr_var_t *ptr, int addr_vn) {
+  for (int k = 0; k < g->mem_num; ++k) {
+    ir_gvn_mem_t *m = &g->mem[k];
+    if (m->addr_vn == addr_vn ||
+        ir_alias(g->cfg, m->ptr, ptr->id) == E_alias_must) {
+      return m;
+    }
+  }
+  return NULL;
+}
+
+static void gvn_load(ir_gvn_t *g, ir_load_t *load) {
+  int addr_vn = vn_of(g, (iropr_t *)load->rhs);
+  ir_gvn_mem_t *m = find_mem(g, load->rhs, addr_vn);
+  if (m && m->inherited && !g->is_const[m->val_vn]) {
+    *m = (ir_gvn_mem_t){addr_vn, load->rhs->id, new_vn(g), 0};
+    def_var(g, load->lhs, m->val_vn);
+    return;
+  }
+  if (m == NULL) {
+    int vn = new_vn(g);
+    def_var(g, load->lhs, vn);
+    push_mem(&g->mem, &g->mem_num, &g->mem_cap,
+             (ir_gvn_mem_t){addr_vn, load->rhs->id, vn, 0});
+    return;
+  }
+  int vn = m->val_vn;
+  iropr_t *to = NULL;
+  if (g->is_const[vn]) {
+    to = (iropr_t *)IROPRNEW(iropr_imm, g->const_val[vn]);
+  } else if (leader(g, vn)) {
+    to = (iropr_t *)leader(g, vn);
+  }
+  if (to && same_iropr(to, (iropr_t *)load->lhs)) {
+    ir_remove(g->cfg, g->index);
+    do_opt = 1;
+    return;
+  }
+  if (to) {
+    ir_replace(g->cfg, g->index, (ir_t *)IRNEW(ir_mov, load->lhs, to));
+    do_opt = 1;
+  }
+  def_var(g, load->lhs, vn);
+}
+
+static void gvn_store(ir_gvn_t *g, ir_store_t *store) {
+  int addr_vn = vn_of(g, (iropr_t *)store->lhs), vn = vn_of(g, store->rhs);
+  ir_gvn_mem_t *m = find_mem(g, store->lhs, addr_vn);
+  if (m && m->val_vn == vn) {
+    ir_remove(g->cfg, g->index);
+    do_opt = 1;
+    return;
+  }
+  int n = 0;
+  for (int k = 0; k < g->mem_num; ++k) {
+    ir_gvn_mem_t *x = &g->mem[k];
+    if (x->addr_vn != addr_vn &&
+        ir_alias(g->cfg, x->ptr, store->lhs->id) == E_alias_no) {
+      g->mem[n++] = *x;
+    }
+  }
+  g->mem_num = n;
+  push_mem(&g->mem, &g->mem_num, &g->mem_cap,
+           (ir_gvn_mem_t){addr_vn, store->lhs->id, vn, 0});
+}
+
+static void gvn_memcpy(ir_gvn_t *g, ir_memcpy_t *copy) {
+  int n = 0;
+  for (int k = 0; k < g->mem_num; ++k) {
+    ir_gvn_mem_t *x = &g->mem[k];
+    if (ir_alias_span(g->cfg, copy->lhs->id, copy->size, x->ptr) == E_alias_no) {
+      g->mem[n++] = *x;
+    }
+  }
+  g->mem_num = n;
+}
+
+static void gvn_call(ir_gvn_t *g, ir_call_t *call) {
+  int n = 0;
+  for (int k = 0; k < g->mem_num; ++k) {
+    if (!ir_alias_call(g->cfg, g->mem[k].ptr)) g->mem[n++] = g->mem[k];
+  }
+  g->mem_num = n;
+  def_var(g, call->ret, new_vn(g));
+}
+
+static void ir_gvn_bb(ir_gvn_t *g, ir_bb_t *bb) {
+  LIST(ir_t*) *irs = g->cfg->irs;
+  for (int i = bb->range.start; i < bb->range.end; ++i) {
+    ir_t *ir = irs->array[i];
+    g->index = i;
+    g->changed = 0;
+    ir_opr_walk(ir, subst_opr, g);
+    if (g->changed) {
+      ir_touch(g->cfg, i);
+      do_opt = 1;
+    }
+    switch (ir->irid) {
+    case E_ir_mov: gvn_mov(g, (ir_mov_t *)ir); break;
+    case E_ir_arth: gvn_arth(g, (ir_arth_t *)ir); break;
+    case E_ir_set: gvn_set(g, (ir_set_t *)ir); break;
+    case E_ir_load: gvn_load(g, (ir_load_t *)ir); break;
+    case E_ir_store: gvn_store(g, (ir_store_t *)ir); break;
+    case E_ir_memcpy: gvn_memcpy(g, (ir_memcpy_t *)ir); break;
+    case E_ir_call: gvn_call(g, (ir_call_t *)ir); break;
+    default: ir_opr_walk(ir, fresh_def, g);
+    }
+  }
+  for (int k = 0; k < g->local_num; ++k) {
+    int x = g->local[k];
+    if (x >= 0) {
+      g->local_vn[x] = VN_NIL;
+    } else {
+      g->local_leader[~x] = NULL;
+    }
+  }
+  g->local_num = 0;
+}
+
+// is parent the only block jumping or falling into bb
+static int only_pred(ir_bb_t *bb, ir_bb_t *parent) {
+  for (int k = 0; k < bb->ins->size; ++k) {
+    if (bb->ins->array[k] != parent) return 0;
+  }
+  return 1;
+}
+
+static void ir_gvn_dom(ir_gvn_t *g, int b) {
+  ir_dom_t *dom = &g->cfg->dom;
+  LIST(ir_bb_t*) *bbs = g->cfg->bbs;
+  int mark = g->log_num;
+  ir_gvn_bb(g, bbs->array[b]);
+  int base = g->saved_num, num = g->mem_num;
+  for (int k = 0; k < num; ++k) {
+    push_mem(&g->saved, &g->saved_num, &g->saved_cap, g->mem[k]);
+  }
+  for (int k = dom->kid_start[b]; k < dom->kid_start[b + 1]; ++k) {
+    int kid = dom->kid[k];
+    g->mem_num = 0;
+    if (only_pred(bbs->array[kid], bbs->array[b])) {
+      for (int j = 0; j < num; ++j) {
+        push_mem(&g->mem, &g->mem_num, &g->mem_cap, g->saved[base + j]);
+        g->mem[j].inherited = 1;
+      }
+    }
+    ir_gvn_dom(g, kid);
+  }
+  g->saved_num = base;
+  while (g->log_num > mark) {
+    int x = g->log[--g->log_num];
+    if (x >= 0) {
+      g->scoped_vn[x] = VN_NIL;
+    } else {
+      g->scoped_leader[~x] = NULL;
+    }
+  }
+}
+
+static void ir_gvn_cfg(ir_gvn_t *g, ir_cfg_t *cfg) {
+  ir_du_t *du = &cfg->du;
+  if (!du->valid || du->var_num != get_ir_program()->var_num) {
+    ir_du_build(cfg);
+  }
+  for (int v = 0; v < du->var_num; ++v) {
+    g->single[v] = du->def_num[v] == 1 && !du->mem[v];
+  }
+  ir_dom_build(cfg);
+  ir_alias_build(cfg);
+  g->cfg = cfg;
+  g->vn_num = 0;
+  g->mem_num = 0;
+  hmap_removeall(g->table);
+  ir_gvn_dom(g, 0);
+  assert(g->log_num == 0);
+}
+
+int ir_gvn() {
+  ir_program_t *program = get_ir_program();
+  ir_gvn_t *g = &gvn;
+  do_opt = 0;
+  if (g->table == NULL) {
+    g->table = new_hmap(same_key, NULL, hash_key, NULL, 0);
+  }
+  if (g->var_cap < program->var_num) {
+    g->var_cap = program->var_num;
+    g->single = realloc(g->single, g->var_cap);
+    g->scoped_vn = realloc(g->scoped_vn, g->var_cap * sizeof(int));
+    g->local_vn = realloc(g->local_vn, g->var_cap * sizeof(int));
+  }
+  memset(g->scoped_vn, 0xff, program->var_num * sizeof(int));
+  memset(g->local_vn, 0xff, program->var_num * sizeof(int));
+  LIST(ir_cfg_t*) *cfgs = program->cfgs;
+  for (int i = 0; i < cfgs->size; ++i) {
+    ir_cfg_t *cfg = cfgs->array[i];
+    if (!cfg->reachable) continue;
+    ir_gvn_cfg(g, cfg);
+  }
+  return do_opt;
+}
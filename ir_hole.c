@@ -64,12 +64,10 @@ static void hole_constant(ir_t *irs[1]) {
     if (arth->opr1->oprid == E_iropr_imm && arth->opr2->oprid == E_iropr_imm) {
       int opr1 = ((iropr_imm_t *)(arth->opr1))->val, 
           opr2 = ((iropr_imm_t *)(arth->opr2))->val, res;
-      switch (arth->op) {
-      case OP2_PLUS: res = opr1 + opr2; break;
-      case OP2_MINUS: res = opr1 - opr2; break;
-      case OP2_STAR: res = opr1 * opr2; break;
-      case OP2_DIV: res = opr2 == 0 ? 0 : opr1 / opr2; break;
-      default: assert(0);
+      if (arth->op == OP2_DIV && opr2 == 0) {
+        res = 0;
+      } else if (!fold_const(arth->op, opr1, opr2, &res)) {
+        return;
       }
       irs[0] = (ir_t *)IRNEW(ir_mov, arth->lhs, (void*)IROPRNEW(iropr_imm, res));
     } else if (arth->op == OP2_PLUS || arth->op == OP2_STAR) {
@@ -90,6 +88,18 @@ static void hole_constant(ir_t *irs[1]) {
         irs[0] = (ir_t *)IRNEW(ir_mov, arth->lhs, (iropr_t *)&IMM0);
       }
     }
+  } else if (ir->irid == E_ir_set) {
+    ir_set_t *set = (ir_set_t *)ir;
+    if (set->opr1->oprid == E_iropr_imm && set->opr2->oprid == E_iropr_imm) {
+      int res = eval_relop(set->op, ((iropr_imm_t *)(set->opr1))->val,
+                           ((iropr_imm_t *)(set->opr2))->val);
+      irs[0] = (ir_t *)IRNEW(ir_mov, set->lhs, (void*)IROPRNEW(iropr_imm, res));
+    } else if (set->opr1->oprid == E_iropr_imm) {
+      iropr_t *opr = set->opr1;
+      set->opr1 = set->opr2;
+      set->opr2 = opr;
+      if (set->op <= 3) set->op = 3 - set->op;
+    }
   } else if (ir->irid == E_ir_branch) {
     ir_branch_t *branch = (ir_branch_t *)ir;
     if (branch->opr1->oprid == E_iropr_imm && branch->opr2->oprid == E_iropr_imm) {
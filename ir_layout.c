@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "ir_visitor.h"
+#include "ir.h"
+
+static int do_opt = 0;
+
+// Pettis-Hansen block layout on static loop-depth weights
+
+#define MAX_DEPTH 10
+
+typedef struct ir_edge {
+  int from, to, no;
+  long long w;
+} ir_edge_t;
+
+typedef struct ir_layout {
+  ir_cfg_t *cfg;
+  ir_edge_t *edges;
+  int edge_num, edge_cap;
+  int *head, *next, *prev, *tail; // chains, tail indexed by head
+  int *order, *placed;
+  ir_t **term;                    // per block, up to two new jumps
+  LIST(ir_t*) *dead;              // old jumps, removed once all are added
+  int cap;
+} ir_layout_t;
+
+static ir_layout_t layout;
+
+static void add_edge(ir_layout_t *l, int from, int to, long long w) {
+  if (l->edge_num == l->edge_cap) {
+    l->edge_cap = l->edge_cap ? l->edge_cap * 2 : 64;
+    l->edges = realloc(l->edges, l->edge_cap * sizeof(ir_edge_t));
+  }
+  l->edges[l->edge_num] = (ir_edge_t){from, to, l->edge_num, w};
+  l->edge_num++;
+}
+
+static int cmp_edge(const void *a, const void *b) {
+  const ir_edge_t *x = a, *y = b;
+  if (x->w != y->w) return x->w < y->w ? 1 : -1;
+  return x->no - y->no;
+}
+
+static ir_t *last_ir(ir_cfg_t *cfg, ir_bb_t *bb) {
+  return cfg->irs->array[bb->range.end - 1];
+}
+
+// eighths of the runs of b that take s rather than o
+static int likely(ir_cfg_t *cfg, ir_bb_t *b, ir_bb_t *s, ir_bb_t *o) {
+  ir_dom_t *dom = &cfg->dom;
+  int sb = s != cfg->exit && ir_dominates(dom, s->no, b->no);
+  int ob = o != cfg->exit && ir_dominates(dom, o->no, b->no);
+  if (sb != ob) return sb ? 7 : 1;
+  int se = s == cfg->exit || dom->depth[s->no] < dom->depth[b->no];
+  int oe = o == cfg->exit || dom->depth[o->no] < dom->depth[b->no];
+  if (se != oe) return se ? 1 : 7;
+  int sr = s != cfg->exit && last_ir(cfg, s)->irid == E_ir_ret;
+  int or = o != cfg->exit && last_ir(cfg, o)->irid == E_ir_ret;
+  if (sr != or) return sr ? 2 : 6;
+  return 4;
+}
+
+static void build_edges(ir_layout_t *l) {
+  ir_cfg_t *cfg = l->cfg;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  l->edge_num = 0;
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i];
+    if (!bb->reachable) continue;
+    int depth = cfg->dom.depth[i] < MAX_DEPTH ? cfg->dom.depth[i] : MAX_DEPTH;
+    long long freq = 1LL << (3 * depth);
+    for (int j = bb->outs->size - 1; j >= 0; --j) {
+      ir_bb_t *s = bb->outs->array[j];
+      if (s == cfg->exit) continue;
+      int p = 8;
+      if (bb->outs->size == 2) {
+        ir_bb_t *o = bb->outs->array[1 - j];
+        p = likely(cfg, bb, s, o);
+      }
+      add_edge(l, i, s->no, freq * p);
+    }
+  }
+  if (l->edge_num < 2) return;
+  qsort(l->edges, l->edge_num, sizeof(ir_edge_t), cmp_edge);
+}
+
+static void build_chains(ir_layout_t *l) {
+  LIST(ir_bb_t*) *bbs = l->cfg->bbs;
+  for (int i = 0; i < bbs->size; ++i) {
+    l->head[i] = l->tail[i] = i;
+    l->next[i] = l->prev[i] = -1;
+  }
+  for (int k = 0; k < l->edge_num; ++k) {
+    int a = l->edges[k].from, s = l->edges[k].to;
+    if (s == 0 || l->next[a] >= 0 || l->prev[s] >= 0) continue;
+    if (l->head[a] == l->head[s] || ir_dominates(&l->cfg->dom, s, a)) continue;
+    int h = l->head[a];
+    l->tail[h] = l->tail[s];
+    l->next[a] = s;
+    l->prev[s] = a;
+    for (int b = s; b >= 0; b = l->next[b]) l->head[b] = h;
+  }
+}
+
+static int place_chains(ir_layout_t *l) {
+  LIST(ir_bb_t*) *bbs = l->cfg->bbs;
+  int n = 0;
+  memset(l->placed, 0, bbs->size * sizeof(int));
+  for (int h = 0; h >= 0; ) {
+    for (int b = h; b >= 0; b = l->next[b]) {
+      l->order[n++] = b;
+      l->placed[b] = 1;
+    }
+    h = -1;
+    for (int k = 0; k < l->edge_num && h < 0; ++k) {
+      ir_edge_t *e = &l->edges[k];
+      if (l->placed[e->from] && !l->placed[e->to]) h = l->head[e->to];
+    }
+    for (int b = 0; b < bbs->size && h < 0; ++b) {
+      if (((ir_bb_t *)bbs->array[b])->reachable && !l->placed[b]) h = l->head[b];
+    }
+  }
+  return n;
+}
+
+static ir_label_t *label_of(ir_bb_t *bb) {
+  if (bb->id == NULL) {
+    bb->id = gen_label();
+    bb->id->bb = bb;
+  }
+  return bb->id;
+}
+
+static ir_t *new_goto(ir_bb_t *to) {
+  ir_t *ir = (ir_t *)IRNEW(ir_goto, label_of(to));
+  add_branch_goto(ir);
+  return ir;
+}
+
+// the jumps that end bb when next follows it
+static void fix_jumps(ir_layout_t *l, ir_bb_t *bb, ir_bb_t *next) {
+  ir_cfg_t *cfg = l->cfg;
+  ir_t *last = last_ir(cfg, bb), **term = &l->term[2 * bb->no];
+  ir_bb_t *fall = NULL;
+  switch (last->irid) {
+  case E_ir_ret: return;
+  case E_ir_goto:
+    if (((ir_goto_t *)last)->label->bb == next) {
+      list_append(l->dead, last);
+      term[0] = NULL;
+      do_opt = 1;
+    }
+    return;
+  case E_ir_branch: {
+    ir_branch_t *br = (ir_branch_t *)last;
+    ir_bb_t *taken = br->label->bb;
+    fall = bb->outs->size > 1 ? bb->outs->array[1] : cfg->exit;
+    if (fall == next) return;
+    if (taken == next) {
+      term[0] = (ir_t *)IRNEW(ir_branch, br->opr1, br->opr2, br->op ^ 1, label_of(fall));
+      add_branch_goto(term[0]);
+      list_append(l->dead, last);
+    } else {
+      term[1] = new_goto(fall);
+    }
+    do_opt = 1;
+    return;
+  }
+  default:
+    fall = bb->outs->size ? bb->outs->array[0] : cfg->exit;
+    if (fall == next) return;
+    term[1] = new_goto(fall);
+    do_opt = 1;
+  }
+}
+
+static void ir_layout_cfg(ir_layout_t *l, ir_cfg_t *cfg) {
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  LIST(ir_t*) *irs = cfg->irs;
+  int n = bbs->size;
+  if (l->cap < n) {
+    l->cap = n;
+    l->head = realloc(l->head, n * sizeof(int));
+    l->next = realloc(l->next, n * sizeof(int));
+    l->prev = realloc(l->prev, n * sizeof(int));
+    l->tail = realloc(l->tail, n * sizeof(int));
+    l->order = realloc(l->order, n * sizeof(int));
+    l->placed = realloc(l->placed, n * sizeof(int));
+    l->term = realloc(l->term, 2 * n * sizeof(ir_t *));
+  }
+  l->cfg = cfg;
+  ir_dom_build(cfg);
+  build_edges(l);
+  build_chains(l);
+  int placed = place_chains(l), moved = 0;
+  for (int k = 0; k < placed; ++k) {
+    ir_bb_t *bb = bbs->array[l->order[k]];
+    l->term[2 * bb->no] = last_ir(cfg, bb);
+    l->term[2 * bb->no + 1] = NULL;
+    if (k && l->order[k] < l->order[k - 1]) moved = 1;
+  }
+  if (!moved) return;
+  do_opt = 1;
+  for (int k = 0; k < placed; ++k) {
+    ir_bb_t *next = k + 1 < placed ? bbs->array[l->order[k + 1]] : cfg->exit;
+    fix_jumps(l, bbs->array[l->order[k]], next);
+  }
+  LIST(ir_t*) *out = new_list();
+  for (int k = 0; k < placed; ++k) {
+    ir_bb_t *bb = bbs->array[l->order[k]];
+    if (bb->id) list_append(out, bb->id);
+    for (int i = bb->range.start; i < bb->range.end - 1; ++i) {
+      list_append(out, irs->array[i]);
+    }
+    for (int j = 0; j < 2; ++j) {
+      if (l->term[2 * bb->no + j]) list_append(out, l->term[2 * bb->no + j]);
+    }
+  }
+  if (cfg->exit->id) list_append(out, cfg->exit->id);
+  for (int i = 0; i < l->dead->size; ++i) remove_branch_goto(l->dead->array[i]);
+  list_clear(l->dead);
+  ir_rebuild_cfg(cfg, out);
+  free(out->array);
+  free(out);
+}
+
+int ir_layout() {
+  ir_program_t *program = get_ir_program();
+  ir_layout_t *l = &layout;
+  do_opt = 0;
+  if (l->dead == NULL) l->dead = new_list();
+  LIST(ir_cfg_t*) *cfgs = program->cfgs;
+  for (int i = 0; i < cfgs->size; ++i) {
+    ir_cfg_t *cfg = cfgs->array[i];
+    if (!cfg->reachable) continue;
+    ir_layout_cfg(l, cfg);
+  }
+  return do_opt;
+}
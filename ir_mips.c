@@ -5,6 +5,12 @@
 #include "ir_visitor.h"
 #include "ir.h"
 
+// block copies up to this many bytes are unrolled, longer ones loop
+#define MEMCPY_UNROLL 128
+#define IS_IMM16(x)  ((x) >= -32768 && (x) <= 32767)
+#define IS_UIMM16(x) ((x) >= 0 && (x) <= 65535)
+#define REG_BIT(r)   ((uint32_t)1 << (r))
+
 static void ir_mips_init(ir_program_t *program) {
   LIST(ir_cfg_t*) *cfgs = program->cfgs;
   int vars = program->var_num;
@@ -14,8 +20,16 @@ static void ir_mips_init(ir_program_t *program) {
     ir_mips_res_t *res = &cfg->mips_res;
     res->stack_size = 0;
     res->mem_var = calloc(vars, 4);
+    res->slot = malloc(vars * sizeof(int));
+    memset(res->slot, 0xff, vars * sizeof(int));
+    res->slot_off = NULL;
+    res->slot_num = res->spilled = res->obj_size = 0;
+    res->remat = calloc(vars, 1);
+    res->remat_val = malloc(vars * sizeof(int));
     memset(res->var_reg, 0xff, sizeof(res->var_reg));
     res->callee_saved = 0;
+    res->clobber = ~0u;
+    res->state = 0;
     res->dirty_var = new_bitset(vars, 0);
     res->cross_call = cfg->livevar_res.cross_call;
     res->mips = new_list();
@@ -28,22 +42,20 @@ static void add_mips(ir_mips_res_t *res, void *mips) {
   list_append(res->mips, mips);
 }
 
-#define CALLER_NUM 15
-#define CALLEE_NUM 8
-#define UREG_NUM   23
-
 static const mipsreg_t reg_caller[CALLER_NUM] = {
   R_A0, R_A1, R_A2, R_A3, R_V0, 
-  R_T0, R_T1, R_T2, R_T3, R_T4, R_T5, R_T6, R_T7, R_T8, R_T9, 
+  R_T0, R_T1, R_T2, R_T3, R_T4, R_T5, R_T6, R_T7, R_T8, 
 };
 
 static const mipsreg_t reg_callee[CALLEE_NUM] = {
   R_S0, R_S1, R_S2, R_S3, R_S4, R_S5, R_S6, R_S7,
 };
 
+static const mipsreg_t reg_arg[4] = {R_A0, R_A1, R_A2, R_A3};
+
 static const mipsreg_t reg_canuse[UREG_NUM] = {
   R_A0, R_A1, R_A2, R_A3, R_V0, 
-  R_T0, R_T1, R_T2, R_T3, R_T4, R_T5, R_T6, R_T7, R_T8, R_T9, 
+  R_T0, R_T1, R_T2, R_T3, R_T4, R_T5, R_T6, R_T7, R_T8, 
   R_S0, R_S1, R_S2, R_S3, R_S4, R_S5, R_S6, R_S7,
 };
 
@@ -53,11 +65,192 @@ static int create_stack(ir_mips_res_t *res, int n) {
 
 static int get_offset(ir_mips_res_t *res, int var_id) {
   if (res->mem_var[var_id] == 0) {
-    res->mem_var[var_id] = create_stack(res, 4);
+    int s = res->slot[var_id];
+    res->spilled++;
+    if (s < 0) {
+      res->mem_var[var_id] = create_stack(res, 4);
+    } else {
+      if (res->slot_off[s] == 0) res->slot_off[s] = create_stack(res, 4);
+      res->mem_var[var_id] = res->slot_off[s];
+    }
   }
   return res->mem_var[var_id];
 }
 
+// Spill slots are colored before code generation.  The live range of a
+// var is the set of points before and after each instruction where it is
+// live, plus the point after each of its defs; vars whose ranges never
+// meet share a slot, since a var is only written back while it is live.
+// A slot takes frame space once some var is really spilled to it.
+
+typedef struct ir_slots {
+  int *local;        // var id -> index among the vars seen, -1 if none
+  int *var;          // index -> var id
+  bitset_t **range;  // per index
+  bitset_t **busy;   // per slot, the union of its ranges
+  int local_cap, var_cap, busy_cap, num;
+  int points;        // grows only, so all sets share one size
+} ir_slots_t;
+
+static ir_slots_t slots;
+
+static bitset_t *grow_points(bitset_t *bs, int n) {
+  if (bs == NULL) return new_bitset(n, 0);
+  bitset_resize(bs, n);
+  bitset_zero(bs);
+  return bs;
+}
+
+static int slot_local(ir_slots_t *s, int var) {
+  if (s->local[var] >= 0) return s->local[var];
+  if (s->num == s->var_cap) {
+    s->var_cap = s->var_cap ? s->var_cap * 2 : 64;
+    s->var = realloc(s->var, s->var_cap * sizeof(int));
+    s->range = realloc(s->range, s->var_cap * sizeof(bitset_t *));
+    for (int k = s->num; k < s->var_cap; ++k) s->range[k] = NULL;
+  }
+  s->var[s->num] = var;
+  s->range[s->num] = grow_points(s->range[s->num], s->points);
+  return s->local[var] = s->num++;
+}
+
+static void slot_live(ir_slots_t *s, bitset_t *live, int point) {
+  for (int v = bitset_next(live, 0); v >= 0; v = bitset_next(live, v + 1)) {
+    int k = slot_local(s, v);
+    bitset_set(s->range[k], point);
+  }
+}
+
+typedef struct ir_slots_def {
+  ir_slots_t *s;
+  int point;
+} ir_slots_def_t;
+
+static void slot_def(ir_slots_def_t *d, iropr_t **opr, opr_role_t role) {
+  if (role != E_opr_def || (*opr)->oprid != E_iropr_var) return;
+  int k = slot_local(d->s, ((iropr_var_t *)*opr)->id);
+  bitset_set(d->s->range[k], d->point);
+}
+
+static void color_slots(ir_cfg_t *cfg) {
+  ir_slots_t *s = &slots;
+  ir_mips_res_t *res = &cfg->mips_res;
+  ir_df_bs_t *live = cfg->livevar_res.res;
+  LIST(ir_t*) *irs = cfg->irs;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  int vars = get_ir_program()->var_num;
+  if (s->local_cap < vars) {
+    s->local_cap = vars;
+    s->local = realloc(s->local, vars * sizeof(int));
+  }
+  memset(s->local, 0xff, vars * sizeof(int));
+  s->num = 0;
+  if (s->points < 2 * irs->size) s->points = 2 * irs->size;
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i];
+    if (!bb->reachable) continue;
+    for (int j = bb->range.start; j < bb->range.end; ++j) {
+      ir_slots_def_t d = {s, 2 * j + 1};
+      slot_live(s, live[j].in, 2 * j);
+      slot_live(s, live[j].out, 2 * j + 1);
+      ir_opr_walk(irs->array[j], slot_def, &d);
+    }
+  }
+  // first fit, in order of first appearance
+  int n = 0;
+  for (int k = 0; k < s->num; ++k) {
+    int c = 0;
+    while (c < n && bitset_meet(s->busy[c], s->range[k])) c++;
+    if (c == n) {
+      if (n == s->busy_cap) {
+        s->busy_cap = s->busy_cap ? s->busy_cap * 2 : 16;
+        s->busy = realloc(s->busy, s->busy_cap * sizeof(bitset_t *));
+        for (int b = n; b < s->busy_cap; ++b) s->busy[b] = NULL;
+      }
+      s->busy[n] = grow_points(s->busy[n], s->points);
+      n++;
+    }
+    bitset_or(s->busy[c], s->range[k]);
+    res->slot[s->var[k]] = c;
+  }
+  res->slot_num = n;
+  res->slot_off = calloc(n ? n : 1, sizeof(int));
+}
+
+typedef struct ir_remat_ctx {
+  ir_mips_res_t *res;
+  ir_t *ir;
+} ir_remat_ctx_t;
+
+static void remat_meet(ir_mips_res_t *res, int var, int kind, int val) {
+  if (res->remat[var] == REMAT_NONE) {
+    res->remat[var] = kind;
+    res->remat_val[var] = val;
+  } else if (res->remat[var] != kind || res->remat_val[var] != val) {
+    res->remat[var] = REMAT_NO;
+  }
+}
+
+static void remat_def(ir_remat_ctx_t *c, iropr_t **opr, opr_role_t role) {
+  if (role != E_opr_def) return;
+  ir_mips_res_t *res = c->res;
+  ir_t *ir = c->ir;
+  int var = ((iropr_var_t *)*opr)->id;
+  if (ir->irid == E_ir_mov && ((ir_mov_t *)ir)->rhs->oprid == E_iropr_imm) {
+    remat_meet(res, var, REMAT_IMM, ((iropr_imm_t *)((ir_mov_t *)ir)->rhs)->val);
+  } else if (ir->irid == E_ir_addr &&
+             IS_IMM16(-res->mem_var[((ir_addr_t *)ir)->rhs->id])) {
+    remat_meet(res, var, REMAT_ADDR, ((ir_addr_t *)ir)->rhs->id);
+  } else {
+    res->remat[var] = REMAT_NO;
+  }
+}
+
+// vars whose every def is the same constant or the same frame address
+// are rebuilt when needed again instead of stored and reloaded
+static void find_remat(ir_cfg_t *cfg) {
+  ir_remat_ctx_t c = {&cfg->mips_res, NULL};
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i];
+    if (!bb->reachable) continue;
+    for (int j = bb->range.start; j < bb->range.end; ++j) {
+      c.ir = cfg->irs->array[j];
+      ir_opr_walk(c.ir, remat_def, &c);
+    }
+  }
+}
+
+static int cmp_alloc(const void *a, const void *b) {
+  return (*(ir_alloc_t **)a)->size - (*(ir_alloc_t **)b)->size;
+}
+
+// stack objects go nearest the frame pointer, smallest first, so that
+// most of them stay in reach of a 16-bit offset
+static void layout_allocs(ir_cfg_t *cfg) {
+  ir_mips_res_t *res = &cfg->mips_res;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  LIST(ir_alloc_t*) *allocs = new_list();
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i];
+    if (!bb->reachable) continue;
+    for (int j = bb->range.start; j < bb->range.end; ++j) {
+      ir_t *ir = cfg->irs->array[j];
+      if (ir->irid == E_ir_alloc) list_append(allocs, ir);
+    }
+  }
+  qsort(allocs->array, allocs->size, sizeof(ir_alloc_t *), cmp_alloc);
+  for (int i = 0; i < allocs->size; ++i) {
+    ir_alloc_t *alloc = allocs->array[i];
+    int size = (alloc->size + 3) & ~3;
+    assert(res->mem_var[alloc->opr->id] == 0);
+    res->mem_var[alloc->opr->id] = create_stack(res, size);
+    res->obj_size += size;
+  }
+  free(allocs->array);
+  free(allocs);
+}
+
 static int find_var_reg(ir_mips_res_t *res, iropr_var_t *opr) {
   for (int i = 0; i < R_NUM; ++i) {
     if (res->var_reg[i] == opr->id) {
@@ -67,10 +260,14 @@ static int find_var_reg(ir_mips_res_t *res, iropr_var_t *opr) {
   return -1;
 }
 
+static int is_remat(ir_mips_res_t *res, int var) {
+  return res->remat[var] == REMAT_IMM || res->remat[var] == REMAT_ADDR;
+}
+
 static void write_back(ir_mips_res_t *res, mipsreg_t reg) {
   assert(res->var_reg[reg] >= 0);
   int var = res->var_reg[reg];
-  if (bitset_test(res->dirty_var, var)) {
+  if (bitset_test(res->dirty_var, var) && !is_remat(res, var)) {
     add_mips(res, MIPSNEW(sw, MIPSSNEW(get_offset(res, var)), MIPSRNEW(reg)));
     bitset_clear(res->dirty_var, var);
   }
@@ -85,21 +282,103 @@ static void write_back_all(ir_mips_res_t *res) {
   }
 }
 
-static void write_back_caller(ir_mips_res_t *res) {
+static uint32_t caller_mask() {
+  uint32_t mask = 0;
+  for (int i = 0; i < CALLER_NUM; ++i) mask |= REG_BIT(reg_caller[i]);
+  return mask;
+}
+
+// caller-saved registers a call to func may change: those of the
+// runtime routines, or the summary of a function already generated
+static uint32_t callee_clobber(char *func) {
+  if (!strcmp(func, "read")) return REG_BIT(R_V0) | REG_BIT(R_A0);
+  if (!strcmp(func, "write")) return REG_BIT(R_V0) | REG_BIT(R_A0);
+  ir_cfg_t *callee = hmap_get(get_ir_program()->func_table, func);
+  assert(callee);
+  return callee->mips_res.clobber;
+}
+
+// what any call of cfg may change: a var live across calls can stay in
+// a caller-saved register outside it
+static uint32_t calls_clobber(ir_cfg_t *cfg) {
+  uint32_t mask = 0;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i];
+    if (!bb->reachable) continue;
+    for (int j = bb->range.start; j < bb->range.end; ++j) {
+      ir_t *ir = cfg->irs->array[j];
+      if (ir->irid == E_ir_call) mask |= callee_clobber(((ir_call_t *)ir)->func);
+      if (ir->irid == E_ir_read) mask |= callee_clobber("read");
+      if (ir->irid == E_ir_write) mask |= callee_clobber("write");
+    }
+  }
+  return mask;
+}
+
+// frees the caller-saved registers in mask, storing what they hold
+static void write_back_caller(ir_mips_res_t *res, uint32_t mask) {
   for (int i = 0; i < CALLER_NUM; ++i) {
-    if (res->var_reg[reg_caller[i]] >= 0) {
+    if ((mask & REG_BIT(reg_caller[i])) && res->var_reg[reg_caller[i]] >= 0) {
       write_back(res, reg_caller[i]);
     }
   }
 }
 
-static int last_alloc_ureg_i = 0;
+// The uses of each instruction of the block being translated, for
+// evicting the var whose next use is furthest away
+typedef struct ir_mips_uses {
+  int *start;  // uses of instruction k are var[start[k] .. start[k + 1])
+  int *var;
+  int num, size, index, var_cap, start_cap;
+} ir_mips_uses_t;
+
+static ir_mips_uses_t uses;
+
+static void add_use(ir_mips_uses_t *u, iropr_t **opr, opr_role_t role) {
+  if ((role != E_opr_use && role != E_opr_ptr) || (*opr)->oprid != E_iropr_var) return;
+  if (u->num == u->var_cap) {
+    u->var_cap = u->var_cap ? u->var_cap * 2 : 64;
+    u->var = realloc(u->var, u->var_cap * sizeof(int));
+  }
+  u->var[u->num++] = ((iropr_var_t *)*opr)->id;
+}
+
+static void build_uses(ir_mips_uses_t *u, LIST(ir_t*) *irs, int st, int ed) {
+  u->size = ed - st;
+  if (u->start_cap < u->size + 1) {
+    u->start_cap = u->size + 1;
+    u->start = realloc(u->start, u->start_cap * sizeof(int));
+  }
+  u->num = 0;
+  for (int k = 0; k < u->size; ++k) {
+    u->start[k] = u->num;
+    ir_opr_walk(irs->array[st + k], add_use, u);
+  }
+  u->start[u->size] = u->num;
+}
+
+// instructions from the current one to the next use of var, the block
+// length if there is none
+static int next_use(ir_mips_uses_t *u, int var) {
+  for (int k = u->index; k < u->size; ++k) {
+    for (int j = u->start[k]; j < u->start[k + 1]; ++j) {
+      if (u->var[j] == var) return k - u->index;
+    }
+  }
+  return u->size;
+}
+
+// a constant or frame address nothing later in the block reads: reload
+// builds it again where it is used
+static int dead_remat(ir_mips_res_t *res, iropr_var_t *var) {
+  return is_remat(res, var->id) && next_use(&uses, var->id) == uses.size;
+}
 
-static int alloc_caller(ir_mips_res_t *res, iropr_var_t *opr) {
+static int alloc_caller(ir_mips_res_t *res, iropr_var_t *opr, uint32_t mask) {
   for (int i = 0; i < CALLER_NUM; ++i) {
-    if (res->var_reg[reg_caller[i]] < 0) {
+    if ((mask & REG_BIT(reg_caller[i])) && res->var_reg[reg_caller[i]] < 0) {
       res->var_reg[reg_caller[i]] = opr->id;
-      last_alloc_ureg_i = i;
       return reg_caller[i];
     }
   }
@@ -111,7 +390,6 @@ static int alloc_callee(ir_mips_res_t *res, iropr_var_t *opr) {
     if (res->var_reg[reg_callee[i]] < 0) {
       res->callee_saved |= CALLEE_SAVED_MASK(reg_callee[i]);
       res->var_reg[reg_callee[i]] = opr->id;
-      last_alloc_ureg_i = CALLER_NUM + i;
       return reg_callee[i];
     }
   }
@@ -121,18 +399,180 @@ static int alloc_callee(ir_mips_res_t *res, iropr_var_t *opr) {
 static int alloc_reg(ir_mips_res_t *res, iropr_var_t *opr) {
   if (bitset_test(res->cross_call, opr->id)) {
     int i;
+    if ((i = alloc_caller(res, opr, ~res->call_clobber)) > 0) return i;
     if ((i = alloc_callee(res, opr)) > 0) return i;
-    if ((i = alloc_caller(res, opr)) > 0) return i;
+    if ((i = alloc_caller(res, opr, ~0u)) > 0) return i;
   } else {
     int i;
-    if ((i = alloc_caller(res, opr)) > 0) return i;
+    if ((i = alloc_caller(res, opr, ~0u)) > 0) return i;
     if ((i = alloc_callee(res, opr)) > 0) return i;
   }
   assert(res->callee_saved == 0xff);
-  last_alloc_ureg_i = (last_alloc_ureg_i + 1) % UREG_NUM;
-  write_back(res, reg_canuse[last_alloc_ureg_i]);
-  res->var_reg[reg_canuse[last_alloc_ureg_i]] = opr->id;
-  return reg_canuse[last_alloc_ureg_i];
+  // furthest next use, then one that needs no store
+  int victim = -1, best = -1;
+  for (int i = 0; i < UREG_NUM; ++i) {
+    int var = res->var_reg[reg_canuse[i]];
+    int free = !bitset_test(res->dirty_var, var) || is_remat(res, var);
+    int score = next_use(&uses, var) * 2 + free;
+    if (score > best) {
+      best = score;
+      victim = reg_canuse[i];
+    }
+  }
+  write_back(res, victim);
+  res->var_reg[victim] = opr->id;
+  return victim;
+}
+
+// reg = val: a single li while addiu or ori can hold it, lui / ori past that
+static void load_imm(LIST(mips_t*) *mips, mipsreg_t reg, int val) {
+  if (IS_IMM16(val) || IS_UIMM16(val)) {
+    list_append(mips, MIPSNEW(move, MIPSRNEW(reg), (mipso_t *)MIPSINEW(val)));
+    return;
+  }
+  list_append(mips, MIPSNEW(lui, MIPSRNEW(reg), (int)((unsigned)val >> 16)));
+  if (val & 0xffff) {
+    list_append(mips, MIPSNEW(logic, MIPSRNEW(reg), MIPSRNEW(reg), 
+      (mipso_t *)MIPSINEW(val & 0xffff), L_OR));
+  }
+}
+
+// lhs = opr1 + c, with c built in scratch if it does not fit addiu
+static void add_imm(LIST(mips_t*) *mips, mipso_reg_t *lhs, mipso_reg_t *opr1, 
+    int c, mipsreg_t scratch) {
+  if (c == 0) {
+    if (lhs->reg != opr1->reg) list_append(mips, MIPSNEW(move, lhs, (mipso_t *)opr1));
+  } else if (IS_IMM16(c)) {
+    list_append(mips, MIPSNEW(arth, lhs, opr1, (mipso_t *)MIPSINEW(c), OP2_PLUS));
+  } else {
+    load_imm(mips, scratch, c);
+    list_append(mips, MIPSNEW(arth, lhs, opr1, (mipso_t *)MIPSRNEW(scratch), OP2_PLUS));
+  }
+}
+
+// reg = var, rebuilt if it is a constant or a frame address
+static void reload(ir_mips_res_t *res, mipsreg_t reg, int var) {
+  if (res->remat[var] == REMAT_IMM) {
+    load_imm(res->mips, reg, res->remat_val[var]);
+  } else if (res->remat[var] == REMAT_ADDR) {
+    int offset = res->mem_var[res->remat_val[var]];
+    assert(IS_IMM16(-offset));
+    add_imm(res->mips, MIPSRNEW(reg), MIPSRNEW(R_FP), -offset, R_V1);
+  } else {
+    add_mips(res, MIPSNEW(lw, MIPSRNEW(reg), MIPSSNEW(get_offset(res, var))));
+  }
+}
+
+#define SHIFT(lhs, opr1, sa, op) MIPSNEW(shift, lhs, opr1, sa, op)
+#define ARTH(lhs, opr1, opr2, op) MIPSNEW(arth, lhs, opr1, (mipso_t *)(opr2), op)
+
+static int log2_exact(unsigned x) {
+  int k = 0;
+  if (x == 0 || (x & (x - 1))) return -1;
+  while (x >>= 1) k++;
+  return k;
+}
+
+// lhs = x * c by shifts and adds, at most three instructions; 0 if c takes
+// more, or if x is the scratch itself
+static int mul_imm(LIST(mips_t*) *mips, mipso_reg_t *lhs, mipso_reg_t *x, int c) {
+  mipso_reg_t *t = MIPSRNEW(R_V1), *zero = MIPSRNEW(R_ZERO);
+  unsigned u = c < 0 ? -(unsigned)c : (unsigned)c;
+  int neg = c < 0, k, hi, lo;
+  if (x->reg == R_V1) return 0;
+  if (c == 0) {
+    list_append(mips, MIPSNEW(move, lhs, (mipso_t *)zero));
+  } else if ((k = log2_exact(u)) >= 0) {
+    if (k == 0 && !neg) {
+      if (lhs->reg != x->reg) list_append(mips, MIPSNEW(move, lhs, (mipso_t *)x));
+      return 1;
+    }
+    if (k == 0) {
+      list_append(mips, ARTH(lhs, zero, x, OP2_MINUS));
+      return 1;
+    }
+    list_append(mips, SHIFT(lhs, x, k, S_SLL));
+  } else if (u < 0x80000000u && (lo = log2_exact(u & -u)) >= 0 &&
+             (hi = log2_exact(u + (u & -u))) >= 0) {
+    // 2^hi - 2^lo; a negative c swaps the operands instead of negating
+    list_append(mips, SHIFT(t, x, hi, S_SLL));
+    if (lo) list_append(mips, SHIFT(lhs, x, lo, S_SLL));
+    mipso_reg_t *low = lo ? lhs : x;
+    list_append(mips, neg ? ARTH(lhs, low, t, OP2_MINUS) : ARTH(lhs, t, low, OP2_MINUS));
+    return 1;
+  } else if (u < 0x80000000u && (lo = log2_exact(u & -u)) >= 0 &&
+             (hi = log2_exact(u - (u & -u))) >= 0 && (lo == 0 || !neg)) {
+    // 2^hi + 2^lo
+    list_append(mips, SHIFT(t, x, hi, S_SLL));
+    if (lo) list_append(mips, SHIFT(lhs, x, lo, S_SLL));
+    list_append(mips, ARTH(lhs, lo ? lhs : x, t, OP2_PLUS));
+  } else {
+    return 0;
+  }
+  if (neg) list_append(mips, ARTH(lhs, zero, lhs, OP2_MINUS));
+  return 1;
+}
+
+// multiplier and shift for signed division by d, |d| >= 2 (Hacker's
+// Delight, 10-1)
+static void magic_div(int d, int *m, int *s) {
+  const unsigned two31 = 0x80000000u;
+  unsigned ad = d < 0 ? -(unsigned)d : (unsigned)d;
+  unsigned t = two31 + ((unsigned)d >> 31);
+  unsigned anc = t - 1 - t % ad;
+  unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+  unsigned q2 = two31 / ad, r2 = two31 - q2 * ad, delta;
+  int p = 31;
+  do {
+    p++;
+    q1 *= 2; r1 *= 2;
+    if (r1 >= anc) { q1++; r1 -= anc; }
+    q2 *= 2; r2 *= 2;
+    if (r2 >= ad) { q2++; r2 -= ad; }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  *m = (int)(q2 + 1);
+  if (d < 0) *m = -*m;
+  *s = p - 32;
+}
+
+// lhs = x / c rounding toward zero: a biased shift for powers of two, a
+// multiply-high by the magic number otherwise; 0 if c is left to div
+static int div_imm(LIST(mips_t*) *mips, mipso_reg_t *lhs, mipso_reg_t *x, int c) {
+  mipso_reg_t *t = MIPSRNEW(R_V1), *zero = MIPSRNEW(R_ZERO);
+  unsigned u = c < 0 ? -(unsigned)c : (unsigned)c;
+  int k = log2_exact(u);
+  if (x->reg == R_V1 || c == 0 || c == INT32_MIN) return 0;
+  if (k == 0) {
+    if (c < 0) {
+      list_append(mips, ARTH(lhs, zero, x, OP2_MINUS));
+    } else if (lhs->reg != x->reg) {
+      list_append(mips, MIPSNEW(move, lhs, (mipso_t *)x));
+    }
+    return 1;
+  }
+  if (k > 0) {
+    // add 2^k - 1 to a negative x before the shift
+    if (k > 1) list_append(mips, SHIFT(t, x, 31, S_SRA));
+    list_append(mips, SHIFT(t, k > 1 ? t : x, 32 - k, S_SRL));
+    list_append(mips, ARTH(t, x, t, OP2_PLUS));
+    list_append(mips, SHIFT(lhs, t, k, S_SRA));
+  } else {
+    int m, s;
+    magic_div(c, &m, &s);
+    load_imm(mips, R_V1, m);
+    list_append(mips, MIPSNEW(mult, x, t));
+    list_append(mips, MIPSNEW(mfhi, t));
+    if (c > 0 && m < 0) list_append(mips, ARTH(t, t, x, OP2_PLUS));
+    if (c < 0 && m > 0) list_append(mips, ARTH(t, t, x, OP2_MINUS));
+    if (s) list_append(mips, SHIFT(t, t, s, S_SRA));
+    // one more toward zero when the quotient is negative
+    list_append(mips, SHIFT(lhs, t, 31, S_SRL));
+    list_append(mips, ARTH(lhs, t, lhs, OP2_PLUS));
+    return 1;
+  }
+  if (c < 0) list_append(mips, ARTH(lhs, zero, lhs, OP2_MINUS));
+  return 1;
 }
 
 static mipso_reg_t *get_rreg(ir_mips_res_t *res, iropr_t *opr) {
@@ -141,7 +581,7 @@ static mipso_reg_t *get_rreg(ir_mips_res_t *res, iropr_t *opr) {
     if (imm->val == 0) {
       return MIPSRNEW(R_ZERO);
     } else {
-      add_mips(res, MIPSNEW(move, MIPSRNEW(R_V1), (mipso_t *)MIPSINEW(imm->val)));
+      load_imm(res->mips, R_V1, imm->val);
       return MIPSRNEW(R_V1);
     }
   } else {
@@ -152,7 +592,7 @@ static mipso_reg_t *get_rreg(ir_mips_res_t *res, iropr_t *opr) {
       return MIPSRNEW(reg);
     } else {
       reg = alloc_reg(res, var);
-      add_mips(res, MIPSNEW(lw, MIPSRNEW(reg), MIPSSNEW(get_offset(res, var->id))));
+      reload(res, reg, var->id);
       assert(!bitset_test(res->dirty_var, var->id));
       return MIPSRNEW(reg);
     }
@@ -202,7 +642,7 @@ static void pass_reg(ir_mips_res_t *res, iropr_t *opr, mipsreg_t reg) {
       add_mips(res, MIPSNEW(move, MIPSRNEW(reg), (mipso_t *)MIPSRNEW(reg2)));
     } else {
       assert(!bitset_test(res->dirty_var, var->id));
-      add_mips(res, MIPSNEW(lw, MIPSRNEW(reg), MIPSSNEW(get_offset(res, var->id))));
+      reload(res, reg, var->id);
       res->var_reg[reg] = var->id;
     }
   } else {
@@ -211,7 +651,65 @@ static void pass_reg(ir_mips_res_t *res, iropr_t *opr, mipsreg_t reg) {
     if (res->var_reg[reg] >= 0) {
       write_back(res, reg);
     }
-    add_mips(res, MIPSNEW(move, MIPSRNEW(reg), (mipso_t *)MIPSINEW(imm->val)));
+    load_imm(res->mips, reg, imm->val);
+  }
+}
+
+// Parallel move of the n operands into the registers dst: every source
+// is read before it is overwritten.  Occupants of dst still live after
+// the instruction are stored first, dead ones are just dropped; register
+// moves go out once their target is no longer a source, and a cycle is
+// broken through $v1.  Constants and spilled vars are loaded last.
+static void pass_regs(ir_mips_res_t *res, iropr_t **opr, const mipsreg_t *dst,
+    int n, bitset_t *live) {
+  int src[4], todo = 0;
+  assert(n <= 4);
+  for (int i = 0; i < n; ++i) {
+    src[i] = -1;
+    if (opr[i]->oprid == E_iropr_var) {
+      int reg = find_var_reg(res, (iropr_var_t *)opr[i]);
+      if (reg > 0) src[i] = reg;
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    int var = res->var_reg[dst[i]];
+    if (src[i] == (int)dst[i]) {
+      src[i] = -2; // already in place
+      continue;
+    }
+    if (var < 0) continue;
+    if (bitset_test(live, var)) {
+      write_back(res, dst[i]);
+    } else {
+      res->var_reg[dst[i]] = -1;
+      bitset_clear(res->dirty_var, var);
+    }
+  }
+  for (int i = 0; i < n; ++i) todo += src[i] >= 0;
+  while (todo) {
+    int i, j;
+    for (i = 0; i < n; ++i) {
+      if (src[i] < 0) continue;
+      for (j = 0; j < n; ++j) {
+        if (j != i && src[j] == (int)dst[i]) break;
+      }
+      if (j == n) break;
+    }
+    if (i == n) {
+      // only cycles are left: free the target of the first one
+      for (i = 0; src[i] < 0; ++i);
+      add_mips(res, MIPSNEW(move, MIPSRNEW(R_V1), (mipso_t *)MIPSRNEW(dst[i])));
+      for (j = 0; j < n; ++j) {
+        if (src[j] == (int)dst[i]) src[j] = R_V1;
+      }
+      continue;
+    }
+    add_mips(res, MIPSNEW(move, MIPSRNEW(dst[i]), (mipso_t *)MIPSRNEW(src[i])));
+    src[i] = -2;
+    todo--;
+  }
+  for (int i = 0; i < n; ++i) {
+    if (src[i] == -1) pass_reg(res, opr[i], dst[i]);
   }
 }
 
@@ -244,6 +742,13 @@ DEF_VISIT_FUNC(ir_mips, ir_func) {
 }
 
 DEF_VISIT_FUNC(ir_mips, ir_mov) {
+  if (n->rhs->oprid == E_iropr_imm) {
+    if (dead_remat(v->res, n->lhs)) return NULL;
+    clean_reg(v->res, v->lvres->out);
+    mipso_reg_t *lhs = get_lreg(v->res, n->lhs);
+    load_imm(v->res->mips, lhs->reg, ((iropr_imm_t *)n->rhs)->val);
+    return NULL;
+  }
   mipso_t *rhs = get_ropr(v->res, n->rhs);
   clean_reg(v->res, v->lvres->out);
   mipso_reg_t *lhs = get_lreg(v->res, n->lhs);
@@ -254,21 +759,112 @@ DEF_VISIT_FUNC(ir_mips, ir_mov) {
   return NULL;
 }
 
+// an immediate goes second, x - c is x + -c, and only addiu takes one
+// directly; the rest are built in a scratch register
 DEF_VISIT_FUNC(ir_mips, ir_arth) {
-  mipso_reg_t *opr1 = get_rreg(v->res, n->opr1);
-  mipso_t *opr2 = get_ropr(v->res, n->opr2);
+  iropr_t *a = n->opr1, *b = n->opr2;
+  op2_t op = n->op;
+  if (a->oprid == E_iropr_imm && (op == OP2_PLUS || op == OP2_STAR)) {
+    a = n->opr2;
+    b = n->opr1;
+  }
+  mipso_reg_t *opr1 = get_rreg(v->res, a);
+  if (b->oprid == E_iropr_imm) {
+    int c = ((iropr_imm_t *)b)->val;
+    mipsreg_t scratch = opr1->reg == R_V1 ? R_T9 : R_V1;
+    if (op == OP2_MINUS && c != INT32_MIN) {
+      op = OP2_PLUS;
+      c = -c;
+    }
+    clean_reg(v->res, v->lvres->out);
+    mipso_reg_t *lhs = get_lreg(v->res, n->lhs);
+    if (op == OP2_PLUS) {
+      add_imm(v->res->mips, lhs, opr1, c, scratch);
+    } else if (op == OP2_STAR && mul_imm(v->res->mips, lhs, opr1, c)) {
+    } else if (op == OP2_DIV && div_imm(v->res->mips, lhs, opr1, c)) {
+    } else {
+      load_imm(v->res->mips, scratch, c);
+      add_mips(v->res, MIPSNEW(arth, lhs, opr1, (mipso_t *)MIPSRNEW(scratch), op));
+    }
+    return NULL;
+  }
+  mipso_reg_t *opr2 = get_rreg(v->res, b);
   clean_reg(v->res, v->lvres->out);
   mipso_reg_t *lhs = get_lreg(v->res, n->lhs);
-  add_mips(v->res, MIPSNEW(arth, lhs, opr1, opr2, n->op));
+  add_mips(v->res, MIPSNEW(arth, lhs, opr1, (mipso_t *)opr2, op));
+  return NULL;
+}
+
+// 0 / 1 by slt and sltu: x <= c is x < c + 1, == and != test the
+// difference against zero, and the negated forms flip the bit with xori
+DEF_VISIT_FUNC(ir_mips, ir_set) {
+  iropr_t *a = n->opr1, *b = n->opr2;
+  relop_t op = n->op;
+  if (a->oprid == E_iropr_imm) {
+    a = n->opr2;
+    b = n->opr1;
+    if (op <= 3) op = 3 - op;
+  }
+  if (a->oprid == E_iropr_imm) {
+    clean_reg(v->res, v->lvres->out);
+    mipso_reg_t *lhs = get_lreg(v->res, n->lhs);
+    int r = eval_relop(op, ((iropr_imm_t *)a)->val, ((iropr_imm_t *)b)->val);
+    add_mips(v->res, MIPSNEW(move, lhs, (mipso_t *)MIPSINEW(r)));
+    return NULL;
+  }
+  mipso_reg_t *x = get_rreg(v->res, a), *y = NULL;
+  int c = b->oprid == E_iropr_imm ? ((iropr_imm_t *)b)->val : 0, imm = 0;
+  if (b->oprid == E_iropr_imm) {
+    switch (op) {
+    case LT: case GE: imm = IS_IMM16(c); break;
+    case LE: case GT: imm = c != INT32_MAX && IS_IMM16(c + 1); break;
+    default: imm = c == 0 || (c != INT32_MIN && IS_IMM16(-c));
+    }
+  }
+  if (!imm) y = get_rreg(v->res, b);
+  clean_reg(v->res, v->lvres->out);
+  mipso_reg_t *lhs = get_lreg(v->res, n->lhs);
+  mipso_reg_t *zero = MIPSRNEW(R_ZERO);
+  mipso_t *bound = imm ? (mipso_t *)MIPSINEW(op == LE || op == GT ? c + 1 : c)
+                       : (mipso_t *)y;
+  switch (op) {
+  case LT: case GE: case LE: case GT:
+    if (!imm && (op == LE || op == GT)) {
+      add_mips(v->res, MIPSNEW(slt, lhs, y, (mipso_t *)x, 0));
+    } else {
+      add_mips(v->res, MIPSNEW(slt, lhs, x, bound, 0));
+    }
+    if (op == GE || (op == LE && !imm) || (op == GT && imm)) {
+      add_mips(v->res, MIPSNEW(logic, lhs, lhs, (mipso_t *)MIPSINEW(1), L_XOR));
+    }
+    break;
+  case EQ: case NEQ: {
+    mipso_reg_t *d = x;
+    if (!imm) {
+      add_mips(v->res, MIPSNEW(arth, lhs, x, (mipso_t *)y, OP2_MINUS));
+      d = lhs;
+    } else if (c != 0) {
+      add_mips(v->res, MIPSNEW(arth, lhs, x, (mipso_t *)MIPSINEW(-c), OP2_PLUS));
+      d = lhs;
+    }
+    if (op == EQ) {
+      add_mips(v->res, MIPSNEW(slt, lhs, d, (mipso_t *)MIPSINEW(1), 1));
+    } else {
+      add_mips(v->res, MIPSNEW(slt, lhs, zero, (mipso_t *)d, 1));
+    }
+    break;
+  }
+  default: assert(0);
+  }
   return NULL;
 }
 
 DEF_VISIT_FUNC(ir_mips, ir_addr) {
+  if (dead_remat(v->res, n->lhs)) return NULL;
   mipso_reg_t *lhs = get_lreg(v->res, n->lhs);
   int offset = v->res->mem_var[n->rhs->id];
   assert(offset);
-  add_mips(v->res, 
-    MIPSNEW(arth, lhs, MIPSRNEW(R_FP), (mipso_t *)MIPSINEW(-offset), OP2_PLUS));
+  add_imm(v->res->mips, lhs, MIPSRNEW(R_FP), -offset, R_V1);
   return NULL;
 }
 
@@ -287,6 +883,43 @@ DEF_VISIT_FUNC(ir_mips, ir_store) {
   return NULL;
 }
 
+DEF_VISIT_FUNC(ir_mips, ir_memcpy) {
+  mipso_reg_t *src = get_rreg(v->res, (iropr_t *)n->rhs);
+  mipso_reg_t *dst = get_rreg(v->res, (iropr_t *)n->lhs);
+  if (src->reg == dst->reg) return NULL;
+  if (n->size <= MEMCPY_UNROLL) {
+    // two words at a time through $v1 and $t9, so no load feeds the next
+    for (int i = 0; i < n->size; i += 8) {
+      int two = i + 4 < n->size;
+      add_mips(v->res, MIPSNEW(lw, MIPSRNEW(R_V1), MIPSMNEW(src->reg, i)));
+      if (two) add_mips(v->res, MIPSNEW(lw, MIPSRNEW(R_T9), MIPSMNEW(src->reg, i + 4)));
+      add_mips(v->res, MIPSNEW(sw, MIPSMNEW(dst->reg, i), MIPSRNEW(R_V1)));
+      if (two) add_mips(v->res, MIPSNEW(sw, MIPSMNEW(dst->reg, i + 4), MIPSRNEW(R_T9)));
+    }
+    return NULL;
+  }
+  // an odd last word goes first, then both pointers walk two words at a
+  // time up to the end in $t9 and are put back; the pointer bumps sit
+  // between each load and its store
+  int size = n->size & ~7, loop = gen_label()->label;
+  if (size != n->size) {
+    add_mips(v->res, MIPSNEW(lw, MIPSRNEW(R_V1), MIPSMNEW(src->reg, size)));
+    add_mips(v->res, MIPSNEW(sw, MIPSMNEW(dst->reg, size), MIPSRNEW(R_V1)));
+  }
+  add_imm(v->res->mips, MIPSRNEW(R_T9), src, size, R_T9);
+  add_mips(v->res, MIPSNEW(label, loop));
+  add_mips(v->res, MIPSNEW(lw, MIPSRNEW(R_V1), MIPSMNEW(src->reg, 0)));
+  add_mips(v->res, MIPSNEW(arth, src, src, (mipso_t *)MIPSINEW(8), OP2_PLUS));
+  add_mips(v->res, MIPSNEW(sw, MIPSMNEW(dst->reg, 0), MIPSRNEW(R_V1)));
+  add_mips(v->res, MIPSNEW(lw, MIPSRNEW(R_V1), MIPSMNEW(src->reg, -4)));
+  add_mips(v->res, MIPSNEW(arth, dst, dst, (mipso_t *)MIPSINEW(8), OP2_PLUS));
+  add_mips(v->res, MIPSNEW(sw, MIPSMNEW(dst->reg, -4), MIPSRNEW(R_V1)));
+  add_mips(v->res, MIPSNEW(bcc, src, (mipso_t *)MIPSRNEW(R_T9), NEQ, loop));
+  add_imm(v->res->mips, src, src, -size, R_V1);
+  add_imm(v->res->mips, dst, dst, -size, R_V1);
+  return NULL;
+}
+
 DEF_VISIT_FUNC(ir_mips, ir_goto) {
   v->end = 1;
   write_back_all(v->res);
@@ -305,15 +938,15 @@ DEF_VISIT_FUNC(ir_mips, ir_branch) {
 }
 
 DEF_VISIT_FUNC(ir_mips, ir_ret) {
+  mipsreg_t ret = R_V0;
   v->end = 1;
-  pass_reg(v->res, n->opr, R_V0);
+  pass_regs(v->res, &n->opr, &ret, 1, v->lvres->out);
   add_mips(v->res, MIPSNEW(ret));
   return NULL;
 }
 
 DEF_VISIT_FUNC(ir_mips, ir_alloc) {
-  assert(v->res->mem_var[n->opr->id] == 0);
-  v->res->mem_var[n->opr->id] = create_stack(v->res, n->size);
+  assert(v->res->mem_var[n->opr->id] > 0);
   return NULL;
 }
 
@@ -325,10 +958,12 @@ DEF_VISIT_FUNC(ir_mips, ir_call) {
       MIPSNEW(arth, MIPSRNEW(R_SP), MIPSRNEW(R_SP), 
         (mipso_t *)MIPSINEW(4 * (4 - args)), OP2_PLUS));
   }
+  // the stack ones first: they may read vars the register ones drop
+  iropr_t *regs[4];
   for (iroprs_t *l = n->args; l; (l = l->next), ++i) {
     iropr_t *opr = l->opr;
     if (i < 4) {
-      pass_reg(v->res, opr, R_A0 + i);
+      regs[i] = opr;
     } else {
       int reg = R_V1;
       if (opr->oprid == E_iropr_var) {
@@ -340,8 +975,9 @@ DEF_VISIT_FUNC(ir_mips, ir_call) {
       add_mips(v->res, MIPSNEW(sw, MIPSMNEW(R_SP, 4 * (i - 4)), MIPSRNEW(reg)));
     }
   }
+  pass_regs(v->res, regs, reg_arg, args < 4 ? args : 4, v->lvres->out);
   clean_reg(v->res, v->lvres->out);
-  write_back_caller(v->res);
+  write_back_caller(v->res, callee_clobber(n->func));
   add_mips(v->res, MIPSNEW(jal, n->func));
   if (args > 4) {
     add_mips(v->res, 
@@ -354,7 +990,7 @@ DEF_VISIT_FUNC(ir_mips, ir_call) {
 }
 
 DEF_VISIT_FUNC(ir_mips, ir_read) {
-  write_back_caller(v->res);
+  write_back_caller(v->res, callee_clobber("read"));
   add_mips(v->res, MIPSNEW(jal, strdup("read")));
   v->res->var_reg[R_V0] = n->opr->id;
   bitset_set(v->res->dirty_var, n->opr->id);
@@ -364,7 +1000,7 @@ DEF_VISIT_FUNC(ir_mips, ir_read) {
 DEF_VISIT_FUNC(ir_mips, ir_write) {
   pass_reg(v->res, n->opr, R_A0);
   clean_reg(v->res, v->lvres->out);
-  write_back_caller(v->res);
+  write_back_caller(v->res, callee_clobber("write"));
   add_mips(v->res, MIPSNEW(jal, strdup("write")));
   return NULL;
 }
@@ -384,10 +1020,12 @@ static void ir_mips_bb(ir_mips_res_t *res, ir_livevar_res_t *lvres,
   if (bb->id) {
     add_mips(res, MIPSNEW(label, bb->id->label));
   }
+  build_uses(&uses, irs, st, ed + 1);
   for (int i = st; i <= ed; ++i) {
     assert(visitor.end == 0);
     visitor.lvres = &(lvres->res[i]);
     visitor.index = i;
+    uses.index = i - st;
     clean_reg(res, lvres->res[i].in);
     ir_visit(&visitor, irs->array[i]);
   }
@@ -397,15 +1035,108 @@ static void ir_mips_bb(ir_mips_res_t *res, ir_livevar_res_t *lvres,
   }
 }
 
+// block that saves the callee-saved registers: the nearest common dominator
+// of their writers that runs once and dominates its returns; -1 = entry
+static int wrap_block(ir_cfg_t *cfg, int *first, int *last) {
+  ir_mips_res_t *res = &cfg->mips_res;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  ir_dom_t *dom = &cfg->dom;
+  uint64_t saved = 0;
+  int d = -1;
+  for (int r = R_S0; r <= R_S7; ++r) saved |= (uint64_t)1 << r;
+  for (int b = 0; b < bbs->size; ++b) {
+    if (first[b] < 0) continue;
+    for (int i = first[b]; i < last[b]; ++i) {
+      if (!(mips_defs(res->mips->array[i]) & saved)) continue;
+      if (d < 0) d = b;
+      while (!ir_dominates(dom, d, b)) d = dom->idom[d];
+      break;
+    }
+  }
+  if (d < 0) return -1;
+  int *stack = malloc(bbs->size * sizeof(int));
+  char *seen = malloc(bbs->size);
+  for (; d != dom->rpo[0]; d = dom->idom[d]) {
+    int sp = 0, ok = 1;
+    memset(seen, 0, bbs->size);
+    stack[sp++] = d;
+    seen[d] = 1;
+    while (sp > 0 && ok) {
+      ir_bb_t *bb = bbs->array[stack[--sp]];
+      mips_t *tail = last[bb->no] > first[bb->no] ? res->mips->array[last[bb->no] - 1] : NULL;
+      if (tail && tail->mipsid == E_mips_ret && !ir_dominates(dom, d, bb->no)) ok = 0;
+      for (int j = 0; j < bb->outs->size; ++j) {
+        ir_bb_t *out = bb->outs->array[j];
+        int o = out->no;
+        if (o == d) ok = 0;
+        if (out == cfg->exit || seen[o]) continue;
+        seen[o] = 1;
+        stack[sp++] = o;
+      }
+    }
+    if (ok) break;
+  }
+  free(seen);
+  free(stack);
+  return d == dom->rpo[0] ? -1 : d;
+}
+
+static void save_regs(LIST(mips_t*) *out, int callee_saved, int stack, int restore) {
+  for (int r = R_S0, j = 0; r <= R_S7; ++r) {
+    if (!(callee_saved & CALLEE_SAVED_MASK(r))) continue;
+    if (restore) {
+      list_append(out, MIPSNEW(lw, MIPSRNEW(r), MIPSMNEW(R_FP, j - stack)));
+    } else {
+      list_append(out, MIPSNEW(sw, MIPSMNEW(R_FP, j - stack), MIPSRNEW(r)));
+    }
+    j += 4;
+  }
+}
+
+// puts the saves at the head of block d and the restores before every
+// return it dominates, addressed off $fp; stack is the frame below it
+static void wrap_saves(ir_cfg_t *cfg, int d, int *first, int *last, int stack) {
+  ir_mips_res_t *res = &cfg->mips_res;
+  LIST(mips_t*) *in = res->mips, *out = new_list();
+  for (int b = 0; b < cfg->bbs->size; ++b) {
+    int i = first[b];
+    if (i < 0) continue;
+    if (b == d) {
+      if (i < last[b] && ((mips_t *)in->array[i])->mipsid == E_mips_label) {
+        list_append(out, in->array[i++]);
+      }
+      save_regs(out, res->callee_saved, stack, 0);
+    }
+    for (; i < last[b]; ++i) {
+      mips_t *m = in->array[i];
+      if (m->mipsid == E_mips_ret && ir_dominates(&cfg->dom, d, b)) {
+        save_regs(out, res->callee_saved, stack, 1);
+      }
+      list_append(out, m);
+    }
+  }
+  free(in->array);
+  free(in);
+  res->mips = out;
+}
+
 static void ir_mips_cfg(ir_cfg_t *cfg) {
   ir_mips_res_t *res = &cfg->mips_res;
   ir_livevar_res_t *lvres = &cfg->livevar_res;
   LIST(ir_t*) *irs = cfg->irs;
   LIST(ir_bb_t*) *bbs = cfg->bbs;
+  int *first = malloc(bbs->size * sizeof(int)), *last = malloc(bbs->size * sizeof(int));
+  layout_allocs(cfg);
+  find_remat(cfg);
+  res->call_clobber = calls_clobber(cfg);
+  color_slots(cfg);
   for (int i = 0; i < bbs->size; ++i) {
     ir_bb_t *curr = bbs->array[i];
+    first[i] = last[i] = -1;
     if (!curr->reachable) continue;
+    first[i] = res->mips->size;
     ir_mips_bb(res, lvres, irs, curr);
+    last[i] = res->mips->size;
   }
   int stack = res->stack_size;
   for (int i = R_S0; i <= R_S7; ++i) {
@@ -413,16 +1144,20 @@ static void ir_mips_cfg(ir_cfg_t *cfg) {
       stack += 4;
     }
   }
+  int wrap = -1;
+  if (res->callee_saved) {
+    ir_dom_build(cfg);
+    wrap = wrap_block(cfg, first, last);
+  }
+  if (wrap >= 0) wrap_saves(cfg, wrap, first, last, stack);
+  free(first);
+  free(last);
   list_append(res->entry, MIPSNEW(func, cfg->name));
-  list_append(res->entry, 
-    MIPSNEW(arth, MIPSRNEW(R_SP), MIPSRNEW(R_SP), 
-      (mipso_t *)MIPSINEW(-stack - 8), OP2_PLUS));
+  add_imm(res->entry, MIPSRNEW(R_SP), MIPSRNEW(R_SP), -stack - 8, R_V1);
   list_append(res->entry, MIPSNEW(sw, MIPSMNEW(R_SP, stack + 4), MIPSRNEW(R_RA)));
   list_append(res->entry, MIPSNEW(sw, MIPSMNEW(R_SP, stack), MIPSRNEW(R_FP)));
-  list_append(res->entry, 
-    MIPSNEW(arth, MIPSRNEW(R_FP), MIPSRNEW(R_SP), 
-      (mipso_t *)MIPSINEW(stack), OP2_PLUS));
-  for (int i = R_S0, j = 0; i <= R_S7; ++i) {
+  add_imm(res->entry, MIPSRNEW(R_FP), MIPSRNEW(R_SP), stack, R_V1);
+  for (int i = R_S0, j = 0; wrap < 0 && i <= R_S7; ++i) {
     if (res->callee_saved & CALLEE_SAVED_MASK(i)) {
       list_append(res->entry, MIPSNEW(sw, MIPSMNEW(R_SP, j), MIPSRNEW(i)));
       list_append(res->exit, MIPSNEW(lw, MIPSRNEW(i), MIPSMNEW(R_SP, j)));
@@ -435,13 +1170,59 @@ static void ir_mips_cfg(ir_cfg_t *cfg) {
   list_append(res->exit, MIPSNEW(lw, MIPSRNEW(R_FP), MIPSMNEW(R_FP, 0)));
 }
 
+// the caller-saved registers the code of cfg writes, and those of the
+// functions it calls; $v0 always carries the result
+static void summarize(ir_cfg_t *cfg) {
+  ir_mips_res_t *res = &cfg->mips_res;
+  uint32_t clobber = REG_BIT(R_V0);
+  for (int i = 0; i < res->mips->size; ++i) {
+    mips_t *m = res->mips->array[i];
+    clobber |= (uint32_t)mips_defs(m);
+    if (m->mipsid == E_mips_jal) clobber |= callee_clobber(((mips_jal_t *)m)->func);
+  }
+  res->clobber = clobber & caller_mask();
+}
+
+// callees first, so that calls see their summaries; a call back into a
+// function still in progress keeps the full set
+static void ir_mips_walk(ir_program_t *program, ir_cfg_t *cfg) {
+  cfg->mips_res.state = 1;
+  LIST(ir_t*) *irs = cfg->irs;
+  for (int i = 0; i < irs->size; ++i) {
+    ir_t *ir = irs->array[i];
+    if (ir->irid != E_ir_call) continue;
+    ir_cfg_t *callee = hmap_get(program->func_table, ((ir_call_t *)ir)->func);
+    if (callee->mips_res.state == 0) ir_mips_walk(program, callee);
+  }
+  ir_mips_cfg(cfg);
+  summarize(cfg);
+  cfg->mips_res.state = 2;
+}
+
 void ir_mips() {
   ir_program_t *program = get_ir_program();
   ir_mips_init(program);
   LIST(ir_cfg_t*) *cfgs = program->cfgs;
+  for (int i = 0; i < cfgs->size; ++i) {
+    ir_cfg_t *cfg = cfgs->array[i];
+    if (!cfg->reachable || cfg->mips_res.state) continue;
+    ir_mips_walk(program, cfg);
+  }
+}
+
+// one line per function: frame bytes, stack objects, spill slots used
+// against the vars spilled into them, and callee-saved registers
+void ir_mips_stats(FILE *fp) {
+  LIST(ir_cfg_t*) *cfgs = get_ir_program()->cfgs;
   for (int i = 0; i < cfgs->size; ++i) {
     ir_cfg_t *cfg = cfgs->array[i];
     if (!cfg->reachable) continue;
-    ir_mips_cfg(cfg);
+    ir_mips_res_t *res = &cfg->mips_res;
+    int saved = __builtin_popcount(res->callee_saved);
+    int used = 0;
+    for (int s = 0; s < res->slot_num; ++s) used += res->slot_off[s] != 0;
+    fprintf(fp, "%s: frame %d, objects %d, slots %d for %d spilled vars, saved %d\n",
+      cfg->name, res->stack_size + 4 * saved + 8, res->obj_size, used,
+      res->spilled, saved);
   }
 }
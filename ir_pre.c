@@ -0,0 +1,605 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stddef.h>
+#include "ir_visitor.h"
+#include "ir.h"
+
+static int do_opt = 0;
+
+// Lazy code motion (Knoop, Ruething and Steffen) over the blocks of a cfg,
+// on a graph whose critical edges carry a node of their own.  Expressions
+// are ir_arth compared by same_ir_arth; each one that gets a redundant
+// computation removed is kept in a fresh temp.  Edge nodes only become code
+// when something is inserted on them.
+
+typedef struct ir_pre_node {
+  bitset_t *antloc, *comp, *transp;
+  bitset_t *ant_in, *ant_out, *av_in, *av_out, *earl, *pp_in, *pp_out;
+  bitset_t *latest, *used_in, *used_out, *tav_in, *tav_out, *insert;
+} ir_pre_node_t;
+
+typedef struct ir_pre {
+  ir_cfg_t *cfg;
+  HMAP(ir_arth_t *, int) *expr_no; // expression -> no + 1
+  ir_arth_t **exprs;
+  int expr_num, expr_cap;
+  int *var_no, var_num, var_cap; // global var id -> local no, -1 = none
+  bitset_t **kill;               // indexed by local var no
+  int kill_num;
+  ir_pre_node_t *nodes;          // bb->no, then one per critical edge
+  int node_num, node_cap, bb_num;
+  int *edge_from, *edge_to;      // of the edge nodes, by node - bb_num
+  int *succ_start, *succ, *pred_start, *pred;
+  bitset_t *buf, *buf2, *sel;
+  char *down;                    // per instruction: a computation that
+                                 // reaches the end of its block
+} ir_pre_t;
+
+static ir_pre_t pre;
+
+static int lookup_expr(ir_pre_t *p, ir_arth_t *arth) {
+  return (int)(uint64_t)hmap_get(p->expr_no, arth) - 1;
+}
+
+static int kill_no(ir_pre_t *p, int id) {
+  if (p->var_no[id] < 0) {
+    p->var_no[id] = p->var_num;
+    if (p->var_num < p->kill_num) {
+      bitset_zero(p->kill[p->var_num]);
+    } else {
+      p->kill[p->kill_num++] = new_bitset(p->expr_cap, 0);
+    }
+    p->var_num++;
+  }
+  return p->var_no[id];
+}
+
+static void add_kill(ir_pre_t *p, iropr_t *opr, int expr) {
+  if (opr->oprid != E_iropr_var) return;
+  bitset_set(p->kill[kill_no(p, ((iropr_var_t *)opr)->id)], expr);
+}
+
+static void ir_pre_number(ir_pre_t *p) {
+  LIST(ir_t*) *irs = p->cfg->irs;
+  ir_program_t *program = get_ir_program();
+  if (p->var_cap < program->var_num) {
+    p->var_cap = program->var_num;
+    p->var_no = realloc(p->var_no, p->var_cap * sizeof(int));
+    p->kill = realloc(p->kill, p->var_cap * sizeof(bitset_t *));
+  }
+  memset(p->var_no, 0xff, program->var_num * sizeof(int));
+  p->var_num = 0;
+  p->expr_num = 0;
+  hmap_removeall(p->expr_no);
+  for (int i = 0; i < irs->size; ++i) {
+    ir_t *ir = irs->array[i];
+    if (ir->irid != E_ir_arth) continue;
+    ir_arth_t *arth = (ir_arth_t *)ir;
+    if (arth->opr1->oprid != E_iropr_var && arth->opr2->oprid != E_iropr_var) {
+      continue;
+    }
+    if (lookup_expr(p, arth) >= 0) continue;
+    if (p->expr_num == p->expr_cap) {
+      p->expr_cap = p->expr_cap ? p->expr_cap * 2 : 64;
+      p->exprs = realloc(p->exprs, p->expr_cap * sizeof(ir_arth_t *));
+    }
+    p->exprs[p->expr_num] = arth;
+    hmap_put(p->expr_no, arth, (void *)(uint64_t)(p->expr_num + 1));
+    p->expr_num++;
+  }
+  for (int k = 0; k < p->kill_num; ++k) {
+    bitset_resize(p->kill[k], p->expr_cap);
+  }
+  for (int e = 0; e < p->expr_num; ++e) {
+    add_kill(p, p->exprs[e]->opr1, e);
+    add_kill(p, p->exprs[e]->opr2, e);
+  }
+}
+
+// bitset_t *bs is cleared of the exprs killed by a def of *opr
+static void kill_opr(bitset_t *bs, iropr_t **opr, opr_role_t role) {
+  if (role != E_opr_def) return;
+  ir_pre_t *p = &pre;
+  int no = p->var_no[((iropr_var_t *)*opr)->id];
+  if (no >= 0) bitset_andnot(bs, p->kill[no]);
+}
+
+static void set_kill(bitset_t *bs, iropr_t **opr, opr_role_t role) {
+  if (role != E_opr_def) return;
+  ir_pre_t *p = &pre;
+  int no = p->var_no[((iropr_var_t *)*opr)->id];
+  if (no >= 0) bitset_or(bs, p->kill[no]);
+}
+
+static bitset_t *node_bitset(bitset_t *bs, int n) {
+  if (bs == NULL) return new_bitset(n, 0);
+  bitset_resize(bs, n);
+  bitset_zero(bs);
+  return bs;
+}
+
+static void ir_pre_alloc(ir_pre_t *p, int nodes) {
+  if (p->node_cap < nodes) {
+    p->nodes = realloc(p->nodes, nodes * sizeof(ir_pre_node_t));
+    memset(p->nodes + p->node_cap, 0,
+      (nodes - p->node_cap) * sizeof(ir_pre_node_t));
+    p->node_cap = nodes;
+  }
+  int n = p->expr_cap; // same size as the kill sets
+  for (int i = 0; i < nodes; ++i) {
+    ir_pre_node_t *x = &p->nodes[i];
+    bitset_t **f = (bitset_t **)x;
+    for (int k = 0; k < sizeof(ir_pre_node_t) / sizeof(bitset_t *); ++k) {
+      f[k] = node_bitset(f[k], n);
+    }
+  }
+  p->buf = node_bitset(p->buf, n);
+  p->buf2 = node_bitset(p->buf2, n);
+  p->sel = node_bitset(p->sel, n);
+}
+
+// ANTLOC: computed before any operand is defined; COMP: computed after the
+// last def of an operand; TRANSP: no operand defined
+static void ir_pre_local(ir_pre_t *p, ir_bb_t *bb) {
+  LIST(ir_t*) *irs = p->cfg->irs;
+  ir_pre_node_t *x = &p->nodes[bb->no];
+  bitset_t *killed = p->buf;
+  bitset_zero(killed);
+  for (int i = bb->range.start; i < bb->range.end; ++i) {
+    ir_t *ir = irs->array[i];
+    int e = ir->irid == E_ir_arth ? lookup_expr(p, (ir_arth_t *)ir) : -1;
+    if (e >= 0) {
+      if (!bitset_test(killed, e)) bitset_set(x->antloc, e);
+      bitset_set(x->comp, e);
+    }
+    ir_opr_walk(ir, set_kill, killed);
+    ir_opr_walk(ir, kill_opr, x->comp);
+  }
+  bitset_one(x->transp);
+  bitset_andnot(x->transp, killed);
+  // mark the computations that survive to the end of the block
+  bitset_zero(killed);
+  for (int i = bb->range.end - 1; i >= bb->range.start; --i) {
+    ir_t *ir = irs->array[i];
+    ir_opr_walk(ir, set_kill, killed);
+    int e = ir->irid == E_ir_arth ? lookup_expr(p, (ir_arth_t *)ir) : -1;
+    p->down[i] = e >= 0 && !bitset_test(killed, e);
+    if (e >= 0) bitset_set(killed, e);
+  }
+}
+
+static void add_edge(ir_pre_t *p, int from, int to, int *num) {
+  if (p->succ) {
+    p->succ[p->succ_start[from] + num[from]] = to;
+    p->pred[p->pred_start[to] + num[p->node_num + to]] = from;
+  }
+  num[from]++;
+  num[p->node_num + to]++;
+}
+
+static int distinct_preds(ir_bb_t *bb) {
+  int n = 0;
+  for (int j = 0; j < bb->ins->size; ++j) {
+    ir_bb_t *in = bb->ins->array[j];
+    if (!in->reachable) continue;
+    int k = 0;
+    while (k < j && bb->ins->array[k] != in) k++;
+    n += k == j;
+  }
+  return n;
+}
+
+// real successors of bb, without duplicates
+static int bb_outs(ir_cfg_t *cfg, ir_bb_t *bb, ir_bb_t **out) {
+  int n = 0;
+  for (int j = 0; j < bb->outs->size; ++j) {
+    ir_bb_t *s = bb->outs->array[j];
+    if (s == cfg->exit || (n > 0 && out[0] == s)) continue;
+    out[n++] = s;
+  }
+  return n;
+}
+
+// splits the critical edges and fills the adjacency, twice: first to count
+static void ir_pre_graph(ir_pre_t *p) {
+  ir_cfg_t *cfg = p->cfg;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  int edges = 0;
+  p->bb_num = bbs->size;
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i], *out[2];
+    if (!bb->reachable) continue;
+    int n = bb_outs(cfg, bb, out);
+    for (int j = 0; n == 2 && j < n; ++j) {
+      edges += distinct_preds(out[j]) > 1;
+    }
+  }
+  p->node_num = bbs->size + edges;
+  p->edge_from = realloc(p->edge_from, (edges + 1) * sizeof(int));
+  p->edge_to = realloc(p->edge_to, (edges + 1) * sizeof(int));
+  int *num = calloc(2 * p->node_num, sizeof(int));
+  free(p->succ);
+  free(p->pred);
+  p->succ = p->pred = NULL;
+  p->succ_start = realloc(p->succ_start, (p->node_num + 1) * sizeof(int));
+  p->pred_start = realloc(p->pred_start, (p->node_num + 1) * sizeof(int));
+  for (int pass = 0; pass < 2; ++pass) {
+    int en = bbs->size;
+    memset(num, 0, 2 * p->node_num * sizeof(int));
+    for (int i = 0; i < bbs->size; ++i) {
+      ir_bb_t *bb = bbs->array[i], *out[2];
+      if (!bb->reachable) continue;
+      int n = bb_outs(cfg, bb, out);
+      for (int j = 0; j < n; ++j) {
+        if (n == 2 && distinct_preds(out[j]) > 1) {
+          p->edge_from[en - bbs->size] = i;
+          p->edge_to[en - bbs->size] = out[j]->no;
+          add_edge(p, i, en, num);
+          add_edge(p, en, out[j]->no, num);
+          en++;
+        } else {
+          add_edge(p, i, out[j]->no, num);
+        }
+      }
+    }
+    if (pass == 1) break;
+    p->succ_start[0] = p->pred_start[0] = 0;
+    for (int k = 0; k < p->node_num; ++k) {
+      p->succ_start[k + 1] = p->succ_start[k] + num[k];
+      p->pred_start[k + 1] = p->pred_start[k] + num[p->node_num + k];
+    }
+    p->succ = malloc((p->succ_start[p->node_num] + 1) * sizeof(int));
+    p->pred = malloc((p->pred_start[p->node_num] + 1) * sizeof(int));
+  }
+  free(num);
+}
+
+static int node_live(ir_pre_t *p, int n) {
+  return n >= p->bb_num || ((ir_bb_t *)p->cfg->bbs->array[n])->reachable;
+}
+
+// dst = meet of field f over the preds (forward) / succs of n; empty if none
+static void meet(ir_pre_t *p, bitset_t *dst, int n, int forward, int is_and,
+    size_t f) {
+  int *adj = forward ? p->pred : p->succ;
+  int *st = forward ? p->pred_start : p->succ_start;
+  if (st[n] == st[n + 1] || (forward && n == 0)) {
+    bitset_zero(dst);
+    return;
+  }
+  if (is_and) bitset_one(dst); else bitset_zero(dst);
+  for (int k = st[n]; k < st[n + 1]; ++k) {
+    bitset_t *src = *(bitset_t **)((char *)&p->nodes[adj[k]] + f);
+    if (is_and) bitset_and(dst, src); else bitset_or(dst, src);
+  }
+}
+
+#define MEET(p, n, fwd, and, dst, src) \
+  meet(p, (p)->nodes[n].dst, n, fwd, and, offsetof(ir_pre_node_t, src))
+
+static void solve(ir_pre_t *p, int forward, void (*step)(ir_pre_t *, int, int *)) {
+  for (int changed = 1; changed; ) {
+    changed = 0;
+    for (int k = 0; k < p->node_num; ++k) {
+      int n = forward ? k : p->node_num - 1 - k;
+      if (node_live(p, n)) step(p, n, &changed);
+    }
+  }
+}
+
+static void update(bitset_t *dst, bitset_t *src, int *changed) {
+  if (bitset_cmp(dst, src)) {
+    bitset_copy(dst, src);
+    *changed = 1;
+  }
+}
+
+static void ant_step(ir_pre_t *p, int n, int *changed) {
+  ir_pre_node_t *x = &p->nodes[n];
+  MEET(p, n, 0, 1, ant_out, ant_in);
+  bitset_copy(p->buf, x->ant_out);
+  bitset_and(p->buf, x->transp);
+  bitset_or(p->buf, x->antloc);
+  update(x->ant_in, p->buf, changed);
+}
+
+// available once the insertions are made
+static void av_step(ir_pre_t *p, int n, int *changed) {
+  ir_pre_node_t *x = &p->nodes[n];
+  MEET(p, n, 1, 1, av_in, av_out);
+  bitset_copy(p->buf, x->ant_in);
+  bitset_or(p->buf, x->av_in);
+  bitset_and(p->buf, x->transp);
+  bitset_or(p->buf, x->comp);
+  update(x->av_out, p->buf, changed);
+}
+
+static void pp_step(ir_pre_t *p, int n, int *changed) {
+  ir_pre_node_t *x = &p->nodes[n];
+  MEET(p, n, 1, 1, pp_in, pp_out);
+  bitset_copy(p->buf, x->earl);
+  bitset_or(p->buf, x->pp_in);
+  bitset_andnot(p->buf, x->antloc);
+  update(x->pp_out, p->buf, changed);
+}
+
+static void used_step(ir_pre_t *p, int n, int *changed) {
+  ir_pre_node_t *x = &p->nodes[n];
+  MEET(p, n, 0, 0, used_out, used_in);
+  bitset_copy(p->buf, x->used_out);
+  bitset_and(p->buf, x->transp);
+  bitset_or(p->buf, x->antloc);
+  bitset_andnot(p->buf, x->latest);
+  update(x->used_in, p->buf, changed);
+}
+
+// the temp holds the expression
+static void tav_step(ir_pre_t *p, int n, int *changed) {
+  ir_pre_node_t *x = &p->nodes[n];
+  MEET(p, n, 1, 1, tav_in, tav_out);
+  bitset_copy(p->buf, x->tav_in);
+  bitset_or(p->buf, x->insert);
+  bitset_and(p->buf, x->transp);
+  bitset_copy(p->buf2, x->comp);
+  bitset_and(p->buf2, x->used_out);
+  bitset_or(p->buf, p->buf2);
+  update(x->tav_out, p->buf, changed);
+}
+
+static int is_fall(ir_pre_t *p, int n) {
+  return p->edge_to[n - p->bb_num] == p->edge_from[n - p->bb_num] + 1;
+}
+
+static int64_t node_weight(ir_pre_t *p, int n) {
+  ir_dom_t *dom = &p->cfg->dom;
+  int depth;
+  if (n < p->bb_num) {
+    depth = dom->depth[n];
+  } else {
+    depth = MIN(dom->depth[p->edge_from[n - p->bb_num]],
+      dom->depth[p->edge_to[n - p->bb_num]]);
+  }
+  return (int64_t)1 << (3 * MIN(depth, 8));
+}
+
+static void add_weight(int64_t *w, bitset_t *bs, int64_t x) {
+  for (int e = bitset_next(bs, 0); e >= 0; e = bitset_next(bs, e + 1)) {
+    w[e] += x;
+  }
+}
+
+// keep the exprs whose removed computations, weighted by loop depth, well
+// outweigh the inserted ones and the stores and loads of the temp
+static void ir_pre_select(ir_pre_t *p) {
+  int64_t *gain = calloc(p->expr_num, sizeof(int64_t));
+  int64_t *cost = calloc(p->expr_num, sizeof(int64_t));
+  for (int n = 0; n < p->node_num; ++n) {
+    if (!node_live(p, n)) continue;
+    ir_pre_node_t *x = &p->nodes[n];
+    int64_t w = node_weight(p, n);
+    bitset_copy(p->buf, x->antloc);
+    bitset_and(p->buf, x->tav_in);
+    add_weight(gain, p->buf, w);
+    // a split jump edge also costs the goto back to its target
+    add_weight(cost, x->insert, n >= p->bb_num && !is_fall(p, n) ? 2 * w : w);
+    // computations that set the temp rather than read it
+    bitset_copy(p->buf, x->tav_in);
+    bitset_or(p->buf, x->insert);
+    bitset_and(p->buf, x->transp);
+    bitset_copy(p->buf2, x->comp);
+    bitset_and(p->buf2, x->used_out);
+    bitset_andnot(p->buf2, p->buf);
+    add_weight(cost, p->buf2, w);
+  }
+  for (int e = 0; e < p->expr_num; ++e) {
+    if (gain[e] > 2 * cost[e]) bitset_set(p->sel, e);
+  }
+  free(cost);
+  free(gain);
+}
+
+static void ir_pre_solve(ir_pre_t *p) {
+  int nodes = p->node_num;
+  for (int n = 0; n < nodes; ++n) {
+    ir_pre_node_t *x = &p->nodes[n];
+    if (n >= p->bb_num) bitset_one(x->transp);
+    bitset_one(x->ant_in);
+    bitset_one(x->av_out);
+    bitset_one(x->pp_out);
+    bitset_one(x->tav_out);
+  }
+  solve(p, 0, ant_step);
+  solve(p, 1, av_step);
+  for (int n = 0; n < nodes; ++n) {
+    ir_pre_node_t *x = &p->nodes[n];
+    bitset_copy(x->earl, x->ant_in);
+    bitset_andnot(x->earl, x->av_in);
+  }
+  solve(p, 1, pp_step);
+  for (int n = 0; n < nodes; ++n) {
+    if (!node_live(p, n)) continue;
+    ir_pre_node_t *x = &p->nodes[n];
+    // latest = (earl | pp_in) & (antloc | ~(and over succs of earl | pp_in))
+    bitset_one(x->latest);
+    for (int k = p->succ_start[n]; k < p->succ_start[n + 1]; ++k) {
+      ir_pre_node_t *s = &p->nodes[p->succ[k]];
+      bitset_copy(p->buf, s->earl);
+      bitset_or(p->buf, s->pp_in);
+      bitset_and(x->latest, p->buf);
+    }
+    bitset_copy(p->buf, x->latest);
+    bitset_one(x->latest);
+    bitset_andnot(x->latest, p->buf);
+    bitset_or(x->latest, x->antloc);
+    bitset_copy(p->buf, x->earl);
+    bitset_or(p->buf, x->pp_in);
+    bitset_and(x->latest, p->buf);
+  }
+  solve(p, 0, used_step);
+  for (int n = 0; n < nodes; ++n) {
+    ir_pre_node_t *x = &p->nodes[n];
+    bitset_copy(x->insert, x->latest);
+    bitset_andnot(x->insert, x->antloc);
+    bitset_and(x->insert, x->used_out);
+  }
+  solve(p, 1, tav_step);
+  ir_pre_select(p);
+}
+
+static void emit_inserts(ir_pre_t *p, LIST(ir_t*) *out, int n,
+    iropr_var_t **temp) {
+  bitset_t *ins = p->nodes[n].insert;
+  for (int e = bitset_next(ins, 0); e >= 0; e = bitset_next(ins, e + 1)) {
+    if (!bitset_test(p->sel, e)) continue;
+    ir_arth_t *a = p->exprs[e];
+    list_append(out, IRNEW(ir_arth, temp[e], a->opr1, a->opr2, a->op));
+  }
+}
+
+static void emit_bb(ir_pre_t *p, LIST(ir_t*) *out, ir_bb_t *bb, int from,
+    iropr_var_t **temp) {
+  LIST(ir_t*) *irs = p->cfg->irs;
+  ir_pre_node_t *x = &p->nodes[bb->no];
+  bitset_t *holds = p->buf;
+  bitset_copy(holds, x->tav_in);
+  bitset_or(holds, x->insert);
+  bitset_and(holds, p->sel);
+  for (int i = from; i < bb->range.end; ++i) {
+    ir_t *ir = irs->array[i];
+    int e = ir->irid == E_ir_arth ? lookup_expr(p, (ir_arth_t *)ir) : -1;
+    if (e < 0 || !bitset_test(p->sel, e)) {
+      list_append(out, ir);
+      ir_opr_walk(ir, kill_opr, holds);
+      continue;
+    }
+    ir_arth_t *arth = (ir_arth_t *)ir;
+    if (bitset_test(holds, e)) {
+      list_append(out, IRNEW(ir_mov, arth->lhs, (iropr_t *)temp[e]));
+    } else if (p->down[i] && bitset_test(x->used_out, e)) {
+      list_append(out, IRNEW(ir_arth, temp[e], arth->opr1, arth->opr2, arth->op));
+      list_append(out, IRNEW(ir_mov, arth->lhs, (iropr_t *)temp[e]));
+      bitset_set(holds, e);
+    } else {
+      list_append(out, ir);
+    }
+    ir_opr_walk(ir, kill_opr, holds);
+  }
+}
+
+static int is_tail(ir_t *ir) {
+  return ir->irid == E_ir_goto || ir->irid == E_ir_ret;
+}
+
+// inserts of the split edge node n, 0 if there are none
+static int edge_inserts(ir_pre_t *p, int n) {
+  bitset_copy(p->buf2, p->nodes[n].insert);
+  bitset_and(p->buf2, p->sel);
+  return bitset_next(p->buf2, 0) >= 0;
+}
+
+// the split edges reached by a branch become blocks of their own: a new
+// label, the inserts and a goto to the old target
+static void emit_jump_edges(ir_pre_t *p, LIST(ir_t*) *out, iropr_var_t **temp) {
+  LIST(ir_t*) *irs = p->cfg->irs;
+  LIST(ir_bb_t*) *bbs = p->cfg->bbs;
+  for (int n = p->bb_num; n < p->node_num; ++n) {
+    if (is_fall(p, n) || !edge_inserts(p, n)) continue;
+    ir_bb_t *from = bbs->array[p->edge_from[n - p->bb_num]];
+    ir_branch_t *br = irs->array[from->range.end - 1];
+    assert(br->irid == E_ir_branch);
+    assert(br->label->bb == bbs->array[p->edge_to[n - p->bb_num]]);
+    ir_label_t *label = gen_label();
+    ir_goto_t *go = IRNEW(ir_goto, br->label);
+    add_branch_goto((ir_t *)go);
+    br->label->ref--;
+    list_remove(br->label->ins, br);
+    br->label = label;
+    add_branch_goto((ir_t *)br);
+    list_append(out, label);
+    emit_inserts(p, out, n, temp);
+    list_append(out, go);
+  }
+}
+
+static int ir_pre_rewrite(ir_pre_t *p) {
+  ir_cfg_t *cfg = p->cfg;
+  LIST(ir_t*) *irs = cfg->irs;
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  // nothing falls through to the slot after the last goto / ret
+  int tail = irs->size;
+  while (tail > 0 && !is_tail(irs->array[tail - 1])) tail--;
+  for (int n = p->bb_num; n < p->node_num; ++n) {
+    if (tail == 0 && !is_fall(p, n) && edge_inserts(p, n)) return 0;
+  }
+  iropr_var_t **temp = malloc(p->expr_num * sizeof(iropr_var_t *));
+  for (int e = bitset_next(p->sel, 0); e >= 0; e = bitset_next(p->sel, e + 1)) {
+    temp[e] = gen_temp_var(p->exprs[e]->lhs->type);
+  }
+  LIST(ir_t*) *out = new_list();
+  int j = 0, n = p->bb_num;
+  for (int k = 0; k <= irs->size; ) {
+    if (k == tail) emit_jump_edges(p, out, temp);
+    if (k == irs->size) break;
+    ir_bb_t *bb = j < bbs->size ? bbs->array[j] : NULL;
+    if (bb == NULL || k < bb->range.start) {
+      list_append(out, irs->array[k++]); // labels and nops between blocks
+      continue;
+    }
+    if (bb->no == 0) {
+      assert(((ir_t *)irs->array[k])->irid == E_ir_func);
+      list_append(out, irs->array[k++]);
+    }
+    if (bb->reachable) {
+      emit_inserts(p, out, bb->no, temp);
+      emit_bb(p, out, bb, k, temp);
+    } else {
+      for (; k < bb->range.end; ++k) list_append(out, irs->array[k]);
+    }
+    for (; n < p->node_num && p->edge_from[n - p->bb_num] == bb->no; ++n) {
+      if (is_fall(p, n)) emit_inserts(p, out, n, temp);
+    }
+    k = bb->range.end;
+    j++;
+  }
+  free(temp);
+  ir_rebuild_cfg(cfg, out);
+  free(out->array);
+  free(out);
+  return 1;
+}
+
+static int ir_pre_cfg(ir_pre_t *p, ir_cfg_t *cfg) {
+  p->cfg = cfg;
+  ir_pre_number(p);
+  if (p->expr_num == 0) return 0;
+  ir_dom_build(cfg);
+  ir_pre_graph(p);
+  ir_pre_alloc(p, p->node_num);
+  p->down = realloc(p->down, cfg->irs->size);
+  LIST(ir_bb_t*) *bbs = cfg->bbs;
+  for (int i = 0; i < bbs->size; ++i) {
+    ir_bb_t *bb = bbs->array[i];
+    if (bb->reachable) ir_pre_local(p, bb);
+  }
+  ir_pre_solve(p);
+  if (bitset_next(p->sel, 0) < 0) return 0;
+  return ir_pre_rewrite(p);
+}
+
+int ir_pre() {
+  ir_program_t *program = get_ir_program();
+  ir_pre_t *p = &pre;
+  do_opt = 0;
+  if (p->expr_no == NULL) {
+    p->expr_no = new_hmap(same_ir_arth, NULL, hash_ir_arth, NULL, 0);
+  }
+  LIST(ir_cfg_t*) *cfgs = program->cfgs;
+  for (int i = 0; i < cfgs->size; ++i) {
+    ir_cfg_t *cfg = cfgs->array[i];
+    if (!cfg->reachable) continue;
+    do_opt |= ir_pre_cfg(p, cfg);
+  }
+  return do_opt;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "ir_visitor.h"
+#include "ir.h"
+
+static int do_opt = 0;
+
+// Sparse clean-ups driven by the def-use chains: dead defs, vars with a
+// single constant def and copies of parameters that are never reassigned.
+
+typedef struct ir_sparse {
+  ir_cfg_t *cfg;
+  worklist_t *worklist;
+  int var, count;
+  iropr_t *to;
+} ir_sparse_t;
+
+static worklist_t *worklist;
+
+static void push_opr(ir_sparse_t *s, iropr_t **opr, opr_role_t role) {
+  if ((*opr)->oprid == E_iropr_var && role != E_opr_mem) {
+    worklist_add(s->worklist, ((iropr_var_t *)*opr)->id);
+  }
+}
+
+static void subst_opr(ir_sparse_t *s, iropr_t **opr, opr_role_t role) {
+  if ((*opr)->oprid != E_iropr_var || ((iropr_var_t *)*opr)->id != s->var) return;
+  if (role == E_opr_use || (role == E_opr_ptr && s->to->oprid == E_iropr_var)) {
+    *opr = s->to;
+    s->count++;
+  }
+}
+
+// lhs of a pure def, NULL otherwise
+static iropr_var_t *pure_lhs(ir_t *ir) {
+  switch (ir->irid) {
+  case E_ir_mov: return ((ir_mov_t *)ir)->lhs;
+  case E_ir_arth: return ((ir_arth_t *)ir)->lhs;
+  case E_ir_set: return ((ir_set_t *)ir)->lhs;
+  case E_ir_addr: return ((ir_addr_t *)ir)->lhs;
+  case E_ir_load: return ((ir_load_t *)ir)->lhs;
+  default: return NULL;
+  }
+}
+
+static void sparse_remove(ir_sparse_t *s, int i) {
+  ir_t *ir = s->cfg->irs->array[i];
+  ir_remove(s->cfg, i);
+  ir_opr_walk(ir, push_opr, s);
+  do_opt = 1;
+}
+
+// the only live def of var, -1 if there is none or more than one
+static int single_def(ir_du_t *du, LIST(ir_t*) *irs, int var) {
+  if (du->def_num[var] != 1) return -1;
+  for (int k = du->def_start[var]; k < du->def_start[var + 1]; ++k) {
+    ir_t *ir = irs->array[du->def[k]];
+    iropr_var_t *lhs = pure_lhs(ir);
+    if (lhs && lhs->id == var) return du->def[k];
+    if (!lhs && ir->irid != E_ir_nop) return -1;
+  }
+  return -1;
+}
+
+static int is_param(ir_du_t *du, LIST(ir_t*) *irs, int var) {
+  if (du->def_num[var] != 1) return 0;
+  for (int k = du->def_start[var]; k < du->def_start[var + 1]; ++k) {
+    if (((ir_t *)irs->array[du->def[k]])->irid == E_ir_func) return 1;
+  }
+  return 0;
+}
+
+static void fold(ir_sparse_t *s, int i) {
+  ir_t *ir = s->cfg->irs->array[i];
+  if (ir->irid == E_ir_set) {
+    ir_set_t *set = (ir_set_t *)ir;
+    if (set->opr1->oprid != E_iropr_imm || set->opr2->oprid != E_iropr_imm) return;
+    int r = eval_relop(set->op, ((iropr_imm_t *)set->opr1)->val,
+                       ((iropr_imm_t *)set->opr2)->val);
+    ir_replace(s->cfg, i,
+      (ir_t *)IRNEW(ir_mov, set->lhs, (iropr_t *)IROPRNEW(iropr_imm, r)));
+    worklist_add(s->worklist, set->lhs->id);
+    return;
+  }
+  if (ir->irid != E_ir_arth) return;
+  ir_arth_t *arth = (ir_arth_t *)ir;
+  if (arth->opr1->oprid != E_iropr_imm || arth->opr2->oprid != E_iropr_imm) return;
+  int x = ((iropr_imm_t *)arth->opr1)->val, y = ((iropr_imm_t *)arth->opr2)->val, r;
+  if (!fold_const(arth->op, x, y, &r)) return;
+  ir_replace(s->cfg, i,
+    (ir_t *)IRNEW(ir_mov, arth->lhs, (iropr_t *)IROPRNEW(iropr_imm, r)));
+  worklist_add(s->worklist, arth->lhs->id);
+}
+
+// replace every use of var by to
+static void propagate(ir_sparse_t *s, int var, iropr_t *to) {
+  ir_du_t *du = &s->cfg->du;
+  LIST(ir_t*) *irs = s->cfg->irs;
+  s->var = var;
+  s->to = to;
+  for (int k = du->use_start[var]; k < du->use_start[var + 1]; ++k) {
+    int i = du->use[k];
+    s->count = 0;
+    ir_opr_walk(irs->array[i], subst_opr, s);
+    if (s->count == 0) continue;
+    do_opt = 1;
+    ir_dirty(s->cfg, i);
+    du->use_num[var] -= s->count;
+    if (to->oprid == E_iropr_var) {
+      du->use_num[((iropr_var_t *)to)->id] += s->count;
+    }
+    fold(s, i);
+    ir_t *ir = irs->array[i];
+    if (ir->irid == E_ir_mov) {
+      worklist_add(s->worklist, ((ir_mov_t *)ir)->lhs->id);
+    }
+  }
+  if (du->use_num[var] == 0) {
+    worklist_add(s->worklist, var);
+  }
+}
+
+static void ir_sparse_cfg(ir_cfg_t *cfg) {
+  ir_du_t *du = &cfg->du;
+  LIST(ir_t*) *irs = cfg->irs;
+  if (!du->valid || du->var_num != get_ir_program()->var_num) {
+    ir_du_build(cfg);
+  }
+  ir_sparse_t s = {cfg, worklist, 0, 0, NULL};
+  int copied = 0;
+  for (int v = 0; v < du->var_num; ++v) {
+    if (du->def_start[v] != du->def_start[v + 1]) {
+      worklist_add(worklist, v);
+    }
+  }
+  while (!worklist_empty(worklist)) {
+    int v = worklist_pop(worklist);
+    if (du->mem[v]) continue;
+    if (du->use_num[v] == 0) {
+      for (int k = du->def_start[v]; k < du->def_start[v + 1]; ++k) {
+        int i = du->def[k];
+        iropr_var_t *lhs = pure_lhs(irs->array[i]);
+        if (lhs && lhs->id == v) {
+          sparse_remove(&s, i);
+        }
+      }
+      continue;
+    }
+    int i = single_def(du, irs, v);
+    if (i < 0 || ((ir_t *)irs->array[i])->irid != E_ir_mov) continue;
+    iropr_t *rhs = ((ir_mov_t *)irs->array[i])->rhs;
+    if (rhs->oprid == E_iropr_imm) {
+      propagate(&s, v, rhs);
+    } else if (!du->mem[((iropr_var_t *)rhs)->id] &&
+        is_param(du, irs, ((iropr_var_t *)rhs)->id)) {
+      // the param's chains do not list the new uses
+      propagate(&s, v, rhs);
+      copied = 1;
+    }
+  }
+  if (copied) cfg->du.valid = 0;
+}
+
+int ir_sparse() {
+  ir_program_t *program = get_ir_program();
+  do_opt = 0;
+  if (worklist == NULL || worklist->size < program->var_num) {
+    worklist = new_worklist(program->var_num);
+  }
+  LIST(ir_cfg_t*) *cfgs = program->cfgs;
+  for (int i = 0; i < cfgs->size; ++i) {
+    ir_cfg_t *cfg = cfgs->array[i];
+    if (!cfg->reachable) continue;
+    ir_sparse_cfg(cfg);
+  }
+  return do_opt;
+}
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "ir_visitor.h"
+#include "ir.h"
+
+static int do_opt = 0;
+
+// Scalar replacement of stack objects.  An ir_alloc object that does not
+// escape and is only reached through addresses at known word offsets gets
+// one var per word: its loads and stores become movs, block copies from or
+// into it are spelled out word by word, and the address arithmetic, the
+// ir_addr and the ir_alloc are left dead for livevar.
+
+typedef struct ir_sroa {
+  ir_cfg_t *cfg;
+  ir_t *ir;
+  int *size;  // indexed by object var id, 0 if not promotable
+  int *base;  // first var of the words, -1 before the first access
+  int cap;
+} ir_sroa_t;
+
+static ir_sroa_t sroa;
+
+static int obj_of(ir_sroa_t *s, iropr_t *opr) {
+  if (opr->oprid != E_iropr_var) return PT_NONE;
+  return s->cfg->alias.obj[((iropr_var_t *)opr)->id];
+}
+
+static void reject(ir_sroa_t *s, int obj) {
+  if (obj >= 0) s->size[obj] = 0;
+}
+
+// does this def of an address into obj keep its offset known
+static int tracked_def(ir_sroa_t *s, ir_t *ir, int obj) {
+  switch (ir->irid) {
+  case E_ir_addr: return 1;
+  case E_ir_mov: return obj_of(s, ((ir_mov_t *)ir)->rhs) == obj;
+  case E_ir_arth: {
+    ir_arth_t *arth = (ir_arth_t *)ir;
+    return (arth->op == OP2_PLUS || arth->op == OP2_MINUS) &&
+           (obj_of(s, arth->opr1) == obj || obj_of(s, arth->opr2) == obj);
+  }
+  default: return 0;
+  }
+}
+
+static void check_opr(ir_sroa_t *s, iropr_t **opr, opr_role_t role) {
+  int obj = obj_of(s, *opr);
+  if (obj < 0 || role == E_opr_mem) return;
+  ir_alias_t *a = &s->cfg->alias;
+  int id = ((iropr_var_t *)*opr)->id, off = a->off[id];
+  ir_t *ir = s->ir;
+  switch (role) {
+  case E_opr_def:
+    if (off == OFF_ANY || !tracked_def(s, ir, obj)) reject(s, obj);
+    break;
+  case E_opr_ptr: {
+    int len = ir->irid == E_ir_memcpy ? ((ir_memcpy_t *)ir)->size : 4;
+    if (off == OFF_ANY || off % 4 != 0 || off < 0 || off + len > s->size[obj]) {
+      reject(s, obj);
+    }
+    break;
+  }
+  default:
+    // an address may only flow into another address of the same object
+    if ((ir->irid != E_ir_mov && ir->irid != E_ir_arth) ||
+        obj_of(s, (iropr_t *)(ir->irid == E_ir_mov ? ((ir_mov_t *)ir)->lhs
+                                                 : ((ir_arth_t *)ir)->lhs)) != obj) {
+      reject(s, obj);
+    }
+  }
+}
+
+// var holding the word at i bytes past the address in ptr, NULL if not
+// promoted
+static iropr_var_t *word_at(ir_sroa_t *s, iropr_var_t *ptr, int i) {
+  ir_alias_t *a = &s->cfg->alias;
+  int obj = a->obj[ptr->id];
+  if (obj < 0 || s->size[obj] == 0) return NULL;
+  if (s->base[obj] < 0) {
+    s->base[obj] = get_ir_program()->var_num;
+    for (int k = 0; k < s->size[obj]; k += 4) new_var_id();
+  }
+  return IROPRNEW(iropr_var, s->base[obj] + (a->off[ptr->id] + i) / 4, &INT);
+}
+
+static void expand_memcpy(ir_sroa_t *s, LIST(ir_t*) *out, ir_memcpy_t *copy) {
+  for (int i = 0; i < copy->size; i += 4) {
+    iropr_imm_t *off = IROPRNEW(iropr_imm, i);
+    iropr_t *val = (iropr_t *)word_at(s, copy->rhs, i);
+    if (val == NULL) {
+      iropr_var_t *addr = gen_temp_var(&INT), *tmp = gen_temp_var(&INT);
+      list_append(out, IRNEW(ir_arth, addr, (iropr_t *)copy->rhs, (iropr_t *)off, OP2_PLUS));
+      list_append(out, IRNEW(ir_load, tmp, addr));
+      val = (iropr_t *)tmp;
+    }
+    iropr_var_t *word = word_at(s, copy->lhs, i);
+    if (word) {
+      list_append(out, IRNEW(ir_mov, word, val));
+    } else {
+      iropr_var_t *addr = gen_temp_var(&INT);
+      list_append(out, IRNEW(ir_arth, addr, (iropr_t *)copy->lhs, (iropr_t *)off, OP2_PLUS));
+      list_append(out, IRNEW(ir_store, addr, val));
+    }
+  }
+}
+
+static void ir_sroa_cfg(ir_sroa_t *s, ir_cfg_t *cfg) {
+  LIST(ir_t*) *irs = cfg->irs;
+  int any = 0;
+  for (int i = 0; i < irs->size; ++i) {
+    ir_t *ir = irs->array[i];
+    if (ir->irid != E_ir_alloc) continue;
+    ir_alloc_t *alloc = (ir_alloc_t *)ir;
+    s->size[alloc->opr->id] = alloc->size;
+    s->base[alloc->opr->id] = -1;
+    any = 1;
+  }
+  if (!any) return;
+  s->cfg = cfg;
+  ir_alias_build(cfg);
+  ir_alias_t *a = &cfg->alias;
+  for (int i = 0; i < irs->size; ++i) {
+    s->ir = irs->array[i];
+    ir_opr_walk(s->ir, check_opr, s);
+  }
+  for (int i = 0; i < irs->size; ++i) {
+    ir_t *ir = irs->array[i];
+    if (ir->irid != E_ir_alloc) continue;
+    if (a->escaped[((ir_alloc_t *)ir)->opr->id]) {
+      s->size[((ir_alloc_t *)ir)->opr->id] = 0;
+    }
+  }
+  int copies = 0;
+  for (int i = 0; i < irs->size; ++i) {
+    ir_t *ir = irs->array[i];
+    iropr_var_t *word;
+    if (ir->irid == E_ir_load) {
+      ir_load_t *load = (ir_load_t *)ir;
+      if ((word = word_at(s, load->rhs, 0)) == NULL) continue;
+      ir_replace(cfg, i, (ir_t *)IRNEW(ir_mov, load->lhs, (iropr_t *)word));
+      do_opt = 1;
+    } else if (ir->irid == E_ir_store) {
+      ir_store_t *store = (ir_store_t *)ir;
+      if ((word = word_at(s, store->lhs, 0)) == NULL) continue;
+      ir_replace(cfg, i, (ir_t *)IRNEW(ir_mov, word, store->rhs));
+      do_opt = 1;
+    } else if (ir->irid == E_ir_memcpy) {
+      ir_memcpy_t *copy = (ir_memcpy_t *)ir;
+      if (word_at(s, copy->lhs, 0) || word_at(s, copy->rhs, 0)) copies = 1;
+    }
+  }
+  if (!copies) return;
+  LIST(ir_t*) *out = new_list();
+  for (int i = 0; i < irs->size; ++i) {
+    ir_t *ir = irs->array[i];
+    if (ir->irid == E_ir_memcpy) {
+      ir_memcpy_t *copy = (ir_memcpy_t *)ir;
+      if (word_at(s, copy->lhs, 0) || word_at(s, copy->rhs, 0)) {
+        expand_memcpy(s, out, copy);
+        continue;
+      }
+    }
+    list_append(out, ir);
+  }
+  ir_rebuild_cfg(cfg, out);
+  free(out->array);
+  free(out);
+  do_opt = 1;
+}
+
+int ir_sroa() {
+  ir_program_t *program = get_ir_program();
+  ir_sroa_t *s = &sroa;
+  do_opt = 0;
+  if (s->cap < program->var_num) {
+    s->cap = program->var_num;
+    s->size = realloc(s->size, s->cap * sizeof(int));
+    s->base = realloc(s->base, s->cap * sizeof(int));
+  }
+  memset(s->size, 0, program->var_num * sizeof(int));
+  LIST(ir_cfg_t*) *cfgs = program->cfgs;
+  for (int i = 0; i < cfgs->size; ++i) {
+    ir_cfg_t *cfg = cfgs->array[i];
+    if (!cfg->reachable) continue;
+    ir_sroa_cfg(s, cfg);
+  }
+  return do_opt;
+}
@@ -6,8 +6,17 @@ int ir_dump(const char *file);
 void build_program();
 int ir_livevar(int final);
 void ir_mips();
+void ir_mips_stats(FILE *fp);
 int ir_avexpr(int final);
 int ir_constant();
 int ir_arthprog(int final);
+int ir_coalesce();
+int ir_sparse();
+int ir_gvn();
+int ir_pre();
+int ir_sroa();
+int ir_dse();
+int ir_compact(int nop_percent);
+int ir_layout();
 
 #endif
@@ -8,6 +8,15 @@ int yyparse();
 
 static int error = 0;
 
+// squeeze NOPs out of a function once they exceed this share of its IR
+#define NOP_PERCENT 25
+
+// fill branch and load delay slots, for targets that expose them
+#define DELAY_SLOTS 0
+
+// print the stack frame of each function to stderr
+#define FRAME_STATS 0
+
 #define WAIT() //({if (argc > 3) {ir_dump(argv[3]);} putchar('\n'); getchar();})
 
 int main(int argc, char** argv) {
@@ -26,13 +35,28 @@ int main(int argc, char** argv) {
   ir_hole_opt();
   if (argc > 4) ir_dump(argv[4]);
   build_program();
+  ir_compact(NOP_PERCENT);
   WAIT();
-  while (ir_constant() | ir_livevar(0) | ir_arthprog(0) | ir_avexpr(0)) WAIT();
-  while (ir_constant() | ir_arthprog(1) | ir_livevar(1)) WAIT();
-  while (ir_constant() | ir_avexpr(1) | ir_livevar(1)) WAIT();
+  do {
+    while (ir_sroa() | ir_constant() | ir_sparse() | ir_gvn() | ir_dse() | ir_livevar(0) | ir_arthprog(0) | ir_avexpr(0)) {
+      ir_compact(NOP_PERCENT);
+      WAIT();
+    }
+  } while (ir_pre());
+  while (ir_constant() | ir_sparse() | ir_arthprog(1) | ir_livevar(1)) {
+    ir_compact(NOP_PERCENT);
+    WAIT();
+  }
+  ir_layout();
+  while (ir_constant() | ir_sparse() | ir_avexpr(1) | ir_livevar(1) || ir_coalesce()) {
+    ir_compact(NOP_PERCENT);
+    WAIT();
+  }
   if (argc > 3) ir_dump(argv[3]);
   ir_mips();
-  return mips_dump(argv[2]);
+  if (FRAME_STATS) ir_mips_stats(stderr);
+  mips_sched(DELAY_SLOTS);
+  return mips_dump(argv[2], DELAY_SLOTS);
 }
 
 void set_error() {
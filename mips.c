@@ -16,7 +16,7 @@ static const char start[] =
   "syscall\n"
   "li $v0, 5\n"
   "syscall\n"
-  "jr $ra\n"
+  "%s"
   "_write:\n"
   "li $v0, 1\n"
   "syscall\n"
@@ -24,7 +24,7 @@ static const char start[] =
   "la $a0, _ret\n"
   "syscall\n"
   "move $v0, $0\n"
-  "jr $ra\n";
+  "%s";
 
 static const char *reg_name[] = {
   "zero", "at",
@@ -81,8 +81,10 @@ DEF_VISIT_FUNC(mips_dumper, mips_label) {
 }
 
 DEF_VISIT_FUNC(mips_dumper, mips_arth) {
+  // the selector leaves an immediate only where addiu takes it
+  assert(n->opr2->oid == E_mipso_reg || n->op == OP2_PLUS);
   switch (n->op) {
-  case OP2_PLUS: FPRINT("addu "); break;
+  case OP2_PLUS: FPRINT(n->opr2->oid == E_mipso_imm ? "addiu " : "addu "); break;
   case OP2_MINUS: FPRINT("subu "); break;
   case OP2_STAR: FPRINT("mul "); break;
   case OP2_DIV: FPRINT("div "); break;
@@ -97,6 +99,61 @@ DEF_VISIT_FUNC(mips_dumper, mips_arth) {
   return NULL;
 }
 
+DEF_VISIT_FUNC(mips_dumper, mips_slt) {
+  FPRINT("slt%s%s ", n->opr2->oid == E_mipso_imm ? "i" : "", n->is_unsigned ? "u" : "");
+  FPUTREG(n->lhs);
+  FPRINT(", ");
+  FPUTREG(n->opr1);
+  FPRINT(", ");
+  dump_opr(v, n->opr2);
+  FPRINT("\n");
+  return NULL;
+}
+
+DEF_VISIT_FUNC(mips_dumper, mips_logic) {
+  FPRINT("%s%s ", ((char *[]){"and", "or", "xor"})[n->op],
+         n->opr2->oid == E_mipso_imm ? "i" : "");
+  FPUTREG(n->lhs);
+  FPRINT(", ");
+  FPUTREG(n->opr1);
+  FPRINT(", ");
+  dump_opr(v, n->opr2);
+  FPRINT("\n");
+  return NULL;
+}
+
+DEF_VISIT_FUNC(mips_dumper, mips_lui) {
+  FPRINT("lui ");
+  FPUTREG(n->lhs);
+  FPRINT(", %d\n", n->imm);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(mips_dumper, mips_shift) {
+  FPRINT("%s ", ((char *[]){"sll", "srl", "sra"})[n->op]);
+  FPUTREG(n->lhs);
+  FPRINT(", ");
+  FPUTREG(n->opr1);
+  FPRINT(", %d\n", n->sa);
+  return NULL;
+}
+
+DEF_VISIT_FUNC(mips_dumper, mips_mult) {
+  FPRINT("mult ");
+  FPUTREG(n->opr1);
+  FPRINT(", ");
+  FPUTREG(n->opr2);
+  FPRINT("\n");
+  return NULL;
+}
+
+DEF_VISIT_FUNC(mips_dumper, mips_mfhi) {
+  FPRINT("mfhi ");
+  FPUTREG(n->lhs);
+  FPRINT("\n");
+  return NULL;
+}
+
 DEF_VISIT_FUNC(mips_dumper, mips_move) {
   switch (n->rhs->oid) {
   case E_mipso_reg: FPRINT("move "); break;
@@ -150,6 +207,11 @@ DEF_VISIT_FUNC(mips_dumper, mips_ret) {
   return NULL;
 }
 
+DEF_VISIT_FUNC(mips_dumper, mips_nop) {
+  FPRINT("nop\n");
+  return NULL;
+}
+
 DEF_VISIT_FUNC(mips_dumper, mips_bcc) {
   switch (n->op) {
   case GT: FPRINT("bgt "); break;
@@ -173,7 +235,8 @@ static mips_visitor_table_t mips_dumper_table = {
   MIPSALL(MIPS_DUMP_FUNC)
 };
 
-int mips_dump(const char *file) {
+// with delay slots the runtime returns get a nop too
+int mips_dump(const char *file, int delay_slots) {
   FILE *fp = fopen(file, "w");
   if (!fp) {
     perror(file);
@@ -182,7 +245,8 @@ int mips_dump(const char *file) {
   ir_program_t *program = get_ir_program();
   mips_dumper_t visitor = {mips_dumper_table, fp, NULL};
   LIST(ir_cfg_t*) *cfgs = program->cfgs;
-  fputs(start, fp);
+  const char *ret = delay_slots ? "jr $ra\nnop\n" : "jr $ra\n";
+  fprintf(fp, start, ret, ret);
   for (int i = 0; i < cfgs->size; ++i) {
     ir_cfg_t *cfg = cfgs->array[i];
     if (!cfg->reachable) continue;
@@ -16,6 +16,15 @@ typedef enum mipsreg {
 #define IS_CALLEE_SAVED(reg)   ((reg) >= R_S0 && (reg) <= R_S7)
 #define CALLEE_SAVED_MASK(reg) (1 << ((reg) - R_S0))
 
+// $v1 and $t9 are scratch registers the allocator never hands out; $k0
+// and $k1 belong to the kernel and are not touched
+#define CALLER_NUM 14
+#define CALLEE_NUM 8
+#define UREG_NUM   22
+
+typedef enum logic { L_AND, L_OR, L_XOR } logic_t;
+typedef enum shift { S_SLL, S_SRL, S_SRA } shift_t;
+
 typedef enum mipso_id { E_mipso_reg, E_mipso_imm, E_mipso_mem } mipso_id_t;
 
 typedef struct mipso { mipso_id_t oid; } mipso_t;
@@ -33,12 +42,19 @@ typedef struct mipso_mem { mipso_id_t oid; mipsreg_t reg; int offset; } mipso_me
   _(mips_func, char *name) \
   _(mips_label, int label) \
   _(mips_arth, mipso_reg_t *lhs, *opr1; mipso_t *opr2; op2_t op) \
+  _(mips_slt, mipso_reg_t *lhs, *opr1; mipso_t *opr2; int is_unsigned) \
+  _(mips_logic, mipso_reg_t *lhs, *opr1; mipso_t *opr2; logic_t op) \
+  _(mips_lui, mipso_reg_t *lhs; int imm) \
+  _(mips_shift, mipso_reg_t *lhs, *opr1; int sa; shift_t op) \
+  _(mips_mult, mipso_reg_t *opr1, *opr2) \
+  _(mips_mfhi, mipso_reg_t *lhs) \
   _(mips_move, mipso_reg_t *lhs; mipso_t *rhs) \
   _(mips_lw, mipso_reg_t *lhs; mipso_mem_t *rhs) \
   _(mips_sw, mipso_mem_t *lhs; mipso_reg_t *rhs) \
   _(mips_j, int label) \
   _(mips_jal, char *func) \
   _(mips_ret) \
+  _(mips_nop) \
   _(mips_bcc, mipso_reg_t *opr1; mipso_t *opr2; relop_t op; int label)
 
 typedef enum { MIPSALL(DEF_ENUM) E_MIPSNUM } mipsid_t;
@@ -54,16 +70,30 @@ MIPSALL(MIPS_DEF_STRUCT)
 
 #define MIPSNEW(name, ...) NEW(mips_##name, E_mips_##name, ##__VA_ARGS__)
 
+#define REMAT_NONE 0 // no def seen yet
+#define REMAT_IMM  1
+#define REMAT_ADDR 2
+#define REMAT_NO   3
+
 typedef struct ir_mips_res {
   int stack_size;
   int *mem_var;
+  int *slot;      // spill slot of a var, -1 if it has none
+  int *slot_off;  // frame offset of a slot, 0 until first used
+  int slot_num, spilled, obj_size;
+  char *remat;    // REMAT_* of a var, how to rebuild it instead of a reload
+  int *remat_val; // the constant, or the object whose address it holds
   int var_reg[R_NUM];
   int callee_saved;
+  uint32_t clobber; // caller-saved registers a call may change, all until known
+  uint32_t call_clobber; // union of clobber over the calls made here
+  int state;        // 0 not generated, 1 in progress, 2 done
   bitset_t *dirty_var, *cross_call;
   LIST(mips_t*) *mips, *entry, *exit;
 } ir_mips_res_t;
 
 typedef void *mips_visitor_table_t[E_MIPSNUM];
 void *mips_visit(void *visitor, void *mips);
+uint64_t mips_defs(mips_t *mips); // registers written, bit r for register r
 
 #endif
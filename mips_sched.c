@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "ir.h"
+#include "mips_visitor.h"
+
+// Critical-path list scheduling of straight-line runs over register, HI
+// and memory dependencies, plus delay-slot filling when DELAY_SLOTS is on
+
+#define LAT_LOAD 2
+#define LAT_MUL  3
+#define LAT_MULT 5
+#define LAT_DIV  11
+
+#define HI_BIT   32
+#define REG(r)   ((r) == R_ZERO ? 0 : (uint64_t)1 << (r))
+#define OPR(o)   ((o)->oid == E_mipso_reg ? REG(((mipso_reg_t *)(o))->reg) : 0)
+
+#define MEM_NONE  0
+#define MEM_LOAD  1
+#define MEM_STORE 2
+
+typedef struct mips_node {
+  mips_t *mips;
+  uint64_t def, use;
+  int mem, base, off;
+  int lat, prio, npred, earliest, done;
+  int *succ, *succ_lat, succ_num, succ_cap;
+} mips_node_t;
+
+typedef struct mips_sched {
+  mips_node_t *nodes;
+  int cap;
+} mips_sched_t;
+
+static mips_sched_t sched;
+
+static int is_barrier(mips_t *m) {
+  switch (m->mipsid) {
+  case E_mips_func:
+  case E_mips_label:
+  case E_mips_j:
+  case E_mips_jal:
+  case E_mips_ret:
+  case E_mips_bcc: return 1;
+  default: return 0;
+  }
+}
+
+static void effects(mips_node_t *x, mips_t *m) {
+  x->def = x->use = 0;
+  x->mem = MEM_NONE;
+  x->lat = 1;
+  switch (m->mipsid) {
+  case E_mips_arth: {
+    mips_arth_t *a = (mips_arth_t *)m;
+    x->def = REG(a->lhs->reg);
+    x->use = REG(a->opr1->reg) | OPR(a->opr2);
+    // div goes through HI/LO and mul leaves HI unpredictable
+    if (a->op == OP2_STAR || a->op == OP2_DIV) x->def |= (uint64_t)1 << HI_BIT;
+    if (a->op == OP2_STAR) x->lat = LAT_MUL;
+    if (a->op == OP2_DIV) x->lat = LAT_DIV;
+    break;
+  }
+  case E_mips_slt: {
+    mips_slt_t *s = (mips_slt_t *)m;
+    x->def = REG(s->lhs->reg);
+    x->use = REG(s->opr1->reg) | OPR(s->opr2);
+    break;
+  }
+  case E_mips_logic: {
+    mips_logic_t *l = (mips_logic_t *)m;
+    x->def = REG(l->lhs->reg);
+    x->use = REG(l->opr1->reg) | OPR(l->opr2);
+    break;
+  }
+  case E_mips_lui: x->def = REG(((mips_lui_t *)m)->lhs->reg); break;
+  case E_mips_shift: {
+    mips_shift_t *s = (mips_shift_t *)m;
+    x->def = REG(s->lhs->reg);
+    x->use = REG(s->opr1->reg);
+    break;
+  }
+  case E_mips_mult: {
+    mips_mult_t *u = (mips_mult_t *)m;
+    x->def = (uint64_t)1 << HI_BIT;
+    x->use = REG(u->opr1->reg) | REG(u->opr2->reg);
+    x->lat = LAT_MULT;
+    break;
+  }
+  case E_mips_mfhi:
+    x->def = REG(((mips_mfhi_t *)m)->lhs->reg);
+    x->use = (uint64_t)1 << HI_BIT;
+    x->lat = LAT_MUL;
+    break;
+  case E_mips_move: {
+    mips_move_t *mv = (mips_move_t *)m;
+    x->def = REG(mv->lhs->reg);
+    x->use = OPR(mv->rhs);
+    break;
+  }
+  case E_mips_lw: {
+    mips_lw_t *lw = (mips_lw_t *)m;
+    x->def = REG(lw->lhs->reg);
+    x->use = REG(lw->rhs->reg);
+    x->mem = MEM_LOAD;
+    x->base = lw->rhs->reg;
+    x->off = lw->rhs->offset;
+    x->lat = LAT_LOAD;
+    break;
+  }
+  case E_mips_sw: {
+    mips_sw_t *sw = (mips_sw_t *)m;
+    x->use = REG(sw->rhs->reg) | REG(sw->lhs->reg);
+    x->mem = MEM_STORE;
+    x->base = sw->lhs->reg;
+    x->off = sw->lhs->offset;
+    break;
+  }
+  case E_mips_bcc: {
+    mips_bcc_t *b = (mips_bcc_t *)m;
+    x->use = REG(b->opr1->reg) | OPR(b->opr2);
+    break;
+  }
+  case E_mips_jal: x->def = x->use = REG(R_RA); break;
+  default: ;
+  }
+}
+
+uint64_t mips_defs(mips_t *mips) {
+  mips_node_t x;
+  effects(&x, mips);
+  return x.def;
+}
+
+// latency from a to a later b, -1 if b may go first
+static int dep(mips_node_t *a, mips_node_t *b) {
+  if (a->def & b->use) return a->lat;
+  if (a->def & b->def) return 1;
+  if (a->use & b->def) return 0;
+  if (a->mem && b->mem && (a->mem == MEM_STORE || b->mem == MEM_STORE)) {
+    if (a->base == b->base && a->off != b->off) return -1;
+    return a->mem == MEM_STORE ? 1 : 0;
+  }
+  return -1;
+}
+
+static void add_succ(mips_node_t *x, int to, int lat) {
+  if (x->succ_num == x->succ_cap) {
+    x->succ_cap = x->succ_cap ? x->succ_cap * 2 : 8;
+    x->succ = realloc(x->succ, x->succ_cap * sizeof(int));
+    x->succ_lat = realloc(x->succ_lat, x->succ_cap * sizeof(int));
+  }
+  x->succ[x->succ_num] = to;
+  x->succ_lat[x->succ_num++] = lat;
+}
+
+// reorder the n instructions from mips[0]
+static void sched_run(mips_sched_t *s, mips_t **mips, int n) {
+  if (n < 2) return;
+  if (s->cap < n) {
+    s->nodes = realloc(s->nodes, n * sizeof(mips_node_t));
+    memset(s->nodes + s->cap, 0, (n - s->cap) * sizeof(mips_node_t));
+    s->cap = n;
+  }
+  mips_node_t *x = s->nodes;
+  for (int i = 0; i < n; ++i) {
+    x[i].mips = mips[i];
+    effects(&x[i], mips[i]);
+    x[i].npred = x[i].earliest = x[i].done = x[i].succ_num = 0;
+  }
+  for (int i = 0; i < n; ++i) {
+    for (int j = i + 1; j < n; ++j) {
+      int lat = dep(&x[i], &x[j]);
+      if (lat < 0) continue;
+      add_succ(&x[i], j, lat);
+      x[j].npred++;
+    }
+  }
+  for (int i = n - 1; i >= 0; --i) {
+    x[i].prio = x[i].lat;
+    for (int k = 0; k < x[i].succ_num; ++k) {
+      int p = x[i].succ_lat[k] + x[x[i].succ[k]].prio;
+      if (p > x[i].prio) x[i].prio = p;
+    }
+  }
+  for (int t = 0, k = 0; k < n; ++k) {
+    int best = -1;
+    for (int i = 0; i < n; ++i) {
+      if (x[i].done || x[i].npred) continue;
+      if (best < 0) {
+        best = i;
+        continue;
+      }
+      int ri = x[i].earliest <= t, rb = x[best].earliest <= t;
+      if (ri != rb) {
+        if (ri) best = i;
+      } else if (!ri && x[i].earliest != x[best].earliest) {
+        if (x[i].earliest < x[best].earliest) best = i;
+      } else if (x[i].prio > x[best].prio) {
+        best = i;
+      }
+    }
+    assert(best >= 0);
+    if (x[best].earliest > t) t = x[best].earliest;
+    x[best].done = 1;
+    mips[k] = x[best].mips;
+    for (int j = 0; j < x[best].succ_num; ++j) {
+      mips_node_t *y = &x[x[best].succ[j]];
+      if (t + x[best].succ_lat[j] > y->earliest) y->earliest = t + x[best].succ_lat[j];
+      y->npred--;
+    }
+    t++;
+  }
+}
+
+// can the last instruction of out, one of the run since the last
+// barrier, move into the delay slot of the branch b
+static int slot_ok(LIST(mips_t*) *out, int run, mips_node_t *b) {
+  mips_node_t c, p;
+  if (run == 0) return 0;
+  effects(&c, list_last(out));
+  if (c.mem == MEM_LOAD || ((mips_t *)list_last(out))->mipsid == E_mips_mfhi) return 0;
+  if ((c.def & b->use) || ((c.def | c.use) & REG(R_RA))) return 0;
+  // nor may it leave a load right before a branch that reads it
+  if (run < 2) return 1;
+  effects(&p, out->array[out->size - 2]);
+  return p.mem != MEM_LOAD || !(p.def & b->use);
+}
+
+static void fill_delay_slots(ir_mips_res_t *res) {
+  LIST(mips_t*) *in = res->mips, *out = new_list();
+  mips_node_t prev = {0}, cur;
+  int run = 0; // movable instructions at the end of out
+  for (int i = 0; i < in->size; ++i) {
+    mips_t *m = in->array[i];
+    effects(&cur, m);
+    if (out->size && prev.mem == MEM_LOAD &&
+        (m->mipsid == E_mips_label || (prev.def & cur.use))) {
+      list_append(out, MIPSNEW(nop));
+      prev.mem = MEM_NONE;
+      run = 0;
+    }
+    if (m->mipsid == E_mips_j || m->mipsid == E_mips_bcc || m->mipsid == E_mips_jal) {
+      mips_t *slot = NULL;
+      if (slot_ok(out, run, &cur)) {
+        slot = list_last(out);
+        out->size--;
+      }
+      list_append(out, m);
+      list_append(out, slot ? slot : (mips_t *)MIPSNEW(nop));
+      prev.mem = MEM_NONE;
+      run = 0;
+      continue;
+    }
+    list_append(out, m);
+    if (m->mipsid == E_mips_ret) list_append(out, MIPSNEW(nop));
+    prev = cur;
+    run = is_barrier(m) ? 0 : run + 1;
+  }
+  free(in->array);
+  free(in);
+  res->mips = out;
+}
+
+static void mips_sched_cfg(ir_mips_res_t *res, int delay_slots) {
+  LIST(mips_t*) *mips = res->mips;
+  int start = 0;
+  for (int i = 0; i <= mips->size; ++i) {
+    if (i < mips->size && !is_barrier(mips->array[i])) continue;
+    sched_run(&sched, (mips_t **)mips->array + start, i - start);
+    start = i + 1;
+  }
+  if (delay_slots) fill_delay_slots(res);
+}
+
+void mips_sched(int delay_slots) {
+  ir_program_t *program = get_ir_program();
+  LIST(ir_cfg_t*) *cfgs = program->cfgs;
+  for (int i = 0; i < cfgs->size; ++i) {
+    ir_cfg_t *cfg = cfgs->array[i];
+    if (!cfg->reachable) continue;
+    mips_sched_cfg(&cfg->mips_res, delay_slots);
+  }
+}
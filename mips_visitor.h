@@ -1,6 +1,7 @@
 #ifndef __MIPS_VISITOR_H__
 #define __MIPS_VISITOR_H__
 
-int mips_dump(const char *file);
+void mips_sched(int delay_slots);
+int mips_dump(const char *file, int delay_slots);
 
 #endif